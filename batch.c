@@ -0,0 +1,639 @@
+/*
+ * --batch, which runs a whole manifest of jobs in one process.
+ *
+ * Each line of the manifest is a job: a source file, then
+ * optionally an input file (- for none) and a file to write the
+ * output to. Anything from a # on is a comment, and blank lines
+ * are skipped. Every source is compiled once and every input read
+ * once, however many jobs use it, and then the jobs run on a pool
+ * of threads through the library in bf.h, with a context for each
+ * thread and the compiled programs shared between all of them.
+ *
+ * The pool does both of those, compiling first and then running,
+ * with each thread starting on its own share of the work. A thread
+ * that runs out takes half of what's left of someone else's, so
+ * a few slow jobs in one share don't hold up the rest. Without
+ * POSIX there are no threads, and everything is done in order.
+ *
+ * The results come out on stdout in the order of the manifest,
+ * one line a job, and the totals on stderr.
+ */
+
+#if defined(__unix__) || defined(__APPLE__)
+#define BATCH_THREADS
+#define _POSIX_C_SOURCE 200809L
+#define _DEFAULT_SOURCE
+#define _DARWIN_C_SOURCE
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef BATCH_THREADS
+#include <pthread.h>
+#include <unistd.h>
+#endif
+
+#include "bf.h"
+#include "bfint.h"
+
+#define BATCH_NONE ((size_t) -1)	/* a job with no input */
+
+/*
+ * A source or input file, read into data. prog is the compiled
+ * program if it's a source, and status says how that went.
+ */
+struct unit {
+	const char *path;
+	char *data;
+	size_t len;
+	struct bf_program *prog;
+	const char *status;
+};
+
+/*
+ * A line of the manifest. prog and input are indices into the
+ * units, and the rest is what running it came to.
+ */
+struct job {
+	const char *src;
+	const char *in;
+	const char *out;
+	size_t prog;
+	size_t input;
+	const char *status;
+	size_t bytes;
+	unsigned long hash;
+	double time;
+};
+
+/* the tasks [lo, hi) that a thread has left */
+struct range {
+#ifdef BATCH_THREADS
+	pthread_mutex_t lock;
+#endif
+	size_t lo;
+	size_t hi;
+};
+
+#ifdef BATCH_THREADS
+#define LOCK(r) pthread_mutex_lock(&(r)->lock)
+#define UNLOCK(r) pthread_mutex_unlock(&(r)->lock)
+#else
+#define LOCK(r) ((void) 0)
+#define UNLOCK(r) ((void) 0)
+#endif
+
+/* where a job's output goes: a file if there is one, and the hash */
+struct sink {
+	FILE *fp;
+	unsigned long hash;
+	size_t len;
+};
+
+struct batch;
+
+/* a thread of the pool, and what it needs for running jobs */
+struct worker {
+	struct batch *batch;
+	int id;
+	struct bf_ctx *ctx;
+	struct sink sink;
+};
+
+struct batch {
+	struct job *jobs;
+	size_t njobs;
+	struct unit *units;	/* the sources, then the inputs */
+	size_t nprogs;
+	size_t nunits;
+	int bits;
+	int engine;
+	int eof;
+	double steps;
+	double seconds;
+	size_t tape;
+	struct range *ranges;
+	int threads;
+	void (*task)(struct worker *w, size_t i);
+};
+
+#define FNV_INIT 2166136261UL
+
+/* bf_write_fn for a job, which hashes the output as it goes */
+static int sink_write(void *user, const unsigned char *buf, size_t len)
+{
+	struct sink *sink = (struct sink *) user;
+	unsigned long h = sink->hash;
+	size_t i;
+
+	for (i = 0; i < len; ++i)
+		h = (h ^ buf[i]) * 16777619UL & 0xffffffffUL;
+	sink->hash = h;
+	sink->len += len;
+
+	return sink->fp && fwrite(buf, 1, len, sink->fp) != len;
+}
+
+/*
+ * Reads the whole of a file, with a NUL after it so the manifest
+ * can be taken apart as a string.
+ *
+ * args: file, where to put what's in it and how long that is
+ * returns: 0 for success, 2 for bad memory allocation, 3 for I/O
+ *          error
+ */
+static INT_STAT read_file(FILE *fp, char **data, size_t *len)
+{
+	size_t cap = IO_BUFSIZE, n;
+	char *p;
+
+	*len = 0;
+	*data = (char *) malloc(cap);
+	if (!*data)
+		return INT_MEMERR;
+
+	while ((n = fread(*data + *len, 1, cap - *len - 1, fp))) {
+		*len += n;
+		if (*len < cap - 1)
+			continue;
+		if (cap > SIZE_MAX / 2)
+			return INT_MEMERR;
+		cap *= 2;
+		p = (char *) realloc(*data, cap);
+		if (!p)
+			return INT_MEMERR;
+		*data = p;
+	}
+	(*data)[*len] = '\0';
+
+	return ferror(fp) ? INT_IOERR : INT_SUCC;
+}
+
+/*
+ * Cuts the next field off a line of the manifest.
+ *
+ * args: where the rest of the line starts, which is moved on
+ * returns: the field, or NULL if there are no more
+ */
+static char *next_field(char **line)
+{
+	char *p = *line, *end;
+
+	while (*p == ' ' || *p == '\t' || *p == '\r')
+		++p;
+	if (!*p || *p == '#')
+		return NULL;
+
+	for (end = p; *end && *end != ' ' && *end != '\t' && *end != '\r';
+	     ++end)
+		;
+	*line = *end ? end + 1 : end;
+	*end = '\0';
+
+	return p;
+}
+
+/*
+ * Takes the manifest apart into jobs, in place, so the fields of
+ * the jobs point into it.
+ *
+ * returns: 0 for success, 1 for a line with too many fields, 2
+ *          for bad memory allocation
+ */
+static INT_STAT parse(struct batch *b, char *text)
+{
+	const char *field[3];
+	char *line, *next, *p;
+	size_t cap = 0;
+	struct job *jobs;
+	int n;
+
+	for (line = text; *line; line = next) {
+		next = strchr(line, '\n');
+		if (next)
+			*next++ = '\0';
+		else
+			next = line + strlen(line);
+
+		for (n = 0; (p = next_field(&line)); field[n++] = p)
+			if (n == 3)
+				return INT_INVL;
+		if (!n)
+			continue;
+
+		if (b->njobs == cap) {
+			cap = cap ? cap * 2 : 64;
+			jobs = (struct job *) realloc(b->jobs,
+						      cap * sizeof(struct job));
+			if (!jobs)
+				return INT_MEMERR;
+			b->jobs = jobs;
+		}
+
+		jobs = &b->jobs[b->njobs++];
+		jobs->src = field[0];
+		jobs->in = n > 1 && strcmp(field[1], "-") ? field[1] : NULL;
+		jobs->out = n > 2 ? field[2] : NULL;
+		jobs->status = NULL;
+		jobs->bytes = 0;
+		jobs->hash = FNV_INIT;
+		jobs->time = 0;
+	}
+
+	return INT_SUCC;
+}
+
+/* a path in the manifest, and which unit it turns out to be */
+struct key {
+	const char *path;
+	size_t *unit;
+};
+
+static int key_cmp(const void *a, const void *b)
+{
+	return strcmp(((const struct key *) a)->path,
+		      ((const struct key *) b)->path);
+}
+
+/*
+ * Gives each different path among some keys a unit of its own,
+ * numbered from b->nunits on.
+ */
+static void number(struct batch *b, struct key *keys, size_t n)
+{
+	size_t i;
+
+	qsort(keys, n, sizeof(struct key), key_cmp);
+	for (i = 0; i < n; ++i) {
+		if (!i || strcmp(keys[i].path, keys[i - 1].path)) {
+			b->units[b->nunits].path = keys[i].path;
+			b->units[b->nunits].data = NULL;
+			b->units[b->nunits].prog = NULL;
+			b->units[b->nunits].status = "ok";
+			++b->nunits;
+		}
+		*keys[i].unit = b->nunits - 1;
+	}
+}
+
+/* works out the units, sources first */
+static INT_STAT units(struct batch *b)
+{
+	struct key *keys;
+	size_t i, n;
+
+	keys = (struct key *) malloc((b->njobs ? b->njobs : 1) *
+				     sizeof(struct key));
+	b->units = (struct unit *) malloc((2 * b->njobs + 1) *
+					  sizeof(struct unit));
+	if (!keys || !b->units) {
+		free(keys);
+		return INT_MEMERR;
+	}
+
+	for (i = 0; i < b->njobs; ++i) {
+		keys[i].path = b->jobs[i].src;
+		keys[i].unit = &b->jobs[i].prog;
+	}
+	number(b, keys, b->njobs);
+	b->nprogs = b->nunits;
+
+	for (i = n = 0; i < b->njobs; ++i) {
+		b->jobs[i].input = BATCH_NONE;
+		if (!b->jobs[i].in)
+			continue;
+		keys[n].path = b->jobs[i].in;
+		keys[n++].unit = &b->jobs[i].input;
+	}
+	number(b, keys, n);
+
+	free(keys);
+
+	return INT_SUCC;
+}
+
+/* the first phase: reads a unit, and compiles it if it's a source */
+static void load(struct worker *w, size_t i)
+{
+	struct batch *b = w->batch;
+	struct unit *u = &b->units[i];
+	INT_STAT status;
+	FILE *fp;
+	int st;
+
+	fp = fopen(u->path, "rb");
+	if (!fp) {
+		u->status = "unreadable";
+		return;
+	}
+	status = read_file(fp, &u->data, &u->len);
+	fclose(fp);
+	if (status != INT_SUCC) {
+		u->status = status == INT_MEMERR ? "memory" : "unreadable";
+		free(u->data);
+		u->data = NULL;
+		return;
+	}
+	if (i >= b->nprogs)
+		return;
+
+	u->prog = bf_compile(u->data, u->len, b->bits, b->engine, &st);
+	u->status = st == BF_INVALID ? "brackets"
+		  : st == BF_NOMEM ? "memory" : "ok";
+
+	/* only the program is needed now */
+	free(u->data);
+	u->data = NULL;
+}
+
+/* the second phase: runs a job */
+static void run(struct worker *w, size_t i)
+{
+	struct batch *b = w->batch;
+	struct job *job = &b->jobs[i];
+	struct unit *prog = &b->units[job->prog];
+	struct unit *in = job->input != BATCH_NONE ? &b->units[job->input]
+						   : NULL;
+	double start;
+	int st;
+
+	if (!prog->prog || (in && !in->data)) {
+		job->status = prog->prog ? in->status : prog->status;
+		return;
+	}
+
+	if (!w->ctx) {
+		w->ctx = bf_ctx_new(b->eof);
+		if (!w->ctx) {
+			job->status = "memory";
+			return;
+		}
+		bf_ctx_io(w->ctx, NULL, sink_write, &w->sink);
+		bf_ctx_limits(w->ctx, b->steps, b->seconds, b->tape);
+	}
+
+	w->sink.fp = NULL;
+	if (job->out) {
+		w->sink.fp = fopen(job->out, "wb");
+		if (!w->sink.fp) {
+			job->status = "write";
+			return;
+		}
+	}
+	w->sink.hash = FNV_INIT;
+	w->sink.len = 0;
+
+	bf_ctx_reset(w->ctx);
+	bf_ctx_input(w->ctx, in ? in->data : NULL, in ? in->len : 0);
+
+	start = io_time();
+	st = bf_run(w->ctx, prog->prog);
+	job->time = io_time() - start;
+
+	if (w->sink.fp && fclose(w->sink.fp) && st == BF_OK)
+		st = BF_IOERR;
+	job->status = st == BF_NOMEM ? "memory" : st == BF_IOERR ? "write"
+		    : st == BF_STEPS ? "steps" : st == BF_TIMEOUT ? "timeout"
+		    : st == BF_TAPE ? "tape" : "ok";
+	job->bytes = w->sink.len;
+	job->hash = w->sink.hash;
+}
+
+/*
+ * Gets a thread its next task, from its own range if there's
+ * anything left in it and from someone else's if not. Only one
+ * lock is ever held at a time: half of the other range is taken
+ * off its end, and then put in the thread's own, which is empty
+ * until then.
+ *
+ * returns: nonzero if there was a task
+ */
+static int next_task(struct batch *b, int id, size_t *task)
+{
+	struct range *own = &b->ranges[id], *r;
+	size_t lo, hi;
+	int i;
+
+	LOCK(own);
+	if (own->lo < own->hi) {
+		*task = own->lo++;
+		UNLOCK(own);
+		return 1;
+	}
+	UNLOCK(own);
+
+	for (i = 1; i < b->threads; ++i) {
+		r = &b->ranges[(id + i) % b->threads];
+		LOCK(r);
+		lo = r->lo + (r->hi - r->lo) / 2;
+		hi = r->hi;
+		if (lo < hi)
+			r->hi = lo;
+		UNLOCK(r);
+		if (lo >= hi)
+			continue;
+
+		LOCK(own);
+		own->lo = lo + 1;
+		own->hi = hi;
+		UNLOCK(own);
+		*task = lo;
+		return 1;
+	}
+
+	return 0;
+}
+
+static void work(struct worker *w)
+{
+	size_t task;
+
+	while (next_task(w->batch, w->id, &task))
+		w->batch->task(w, task);
+}
+
+#ifdef BATCH_THREADS
+static void *work_thread(void *arg)
+{
+	work((struct worker *) arg);
+
+	return NULL;
+}
+#endif
+
+/*
+ * Does n tasks on the pool, sharing them out evenly to start
+ * with. The calling thread is one of the pool. If some threads
+ * can't be started, the rest take their shares from them.
+ */
+static void pool_run(struct batch *b, struct worker *workers, size_t n,
+		     void (*task)(struct worker *w, size_t i))
+{
+#ifdef BATCH_THREADS
+	pthread_t *tids;
+	int *started;
+#endif
+	size_t share = n / b->threads, extra = n % b->threads, lo = 0;
+	int i;
+
+	/* the first extra threads get one more */
+	b->task = task;
+	for (i = 0; i < b->threads; ++i) {
+		b->ranges[i].lo = lo;
+		lo += share + ((size_t) i < extra);
+		b->ranges[i].hi = lo;
+	}
+
+#ifdef BATCH_THREADS
+	tids = (pthread_t *) malloc(b->threads * sizeof(pthread_t));
+	started = (int *) calloc(b->threads, sizeof(int));
+	if (tids && started)
+		for (i = 1; i < b->threads; ++i)
+			started[i] = !pthread_create(&tids[i], NULL,
+						     work_thread, &workers[i]);
+	work(&workers[0]);
+	if (tids && started)
+		for (i = 1; i < b->threads; ++i)
+			if (started[i])
+				pthread_join(tids[i], NULL);
+	free(tids);
+	free(started);
+#else
+	work(&workers[0]);
+#endif
+}
+
+/* how many threads to use if --threads didn't say */
+static int default_threads(void)
+{
+#if defined(BATCH_THREADS) && defined(_SC_NPROCESSORS_ONLN)
+	long n = sysconf(_SC_NPROCESSORS_ONLN);
+
+	return n < 1 ? 1 : n > BATCH_THREADS_MAX ? BATCH_THREADS_MAX : (int) n;
+#else
+	return 1;
+#endif
+}
+
+/*
+ * Runs every job in a manifest, writing a line for each one to
+ * stdout and the totals to stderr. The line is the job's number,
+ * from 1, how it went (ok, unreadable, brackets, memory, write,
+ * steps, timeout or tape), how many bytes it wrote, a 32-bit FNV-1a
+ * hash of them, the seconds it took to run, its source and its
+ * input.
+ *
+ * args: manifest, bits in a cell, engine (BF_THREADED, BF_SWITCH
+ *       or BF_JIT), what , gives at the end of input, most steps,
+ *       seconds and bytes of tape for each job as for
+ *       bf_ctx_limits(), threads
+ *       to use or 0 for one a processor, where to put how many
+ *       jobs failed
+ * returns: 0 for success, 1 for a bad line in the manifest,
+ *          2 for bad memory allocation, 3 for I/O error
+ */
+INT_STAT batch_run(FILE *fp, int bits, int engine, int eof, double steps,
+		   double seconds, size_t tape, int threads, size_t *failed)
+{
+	struct worker *workers = NULL;
+	char *text = NULL;
+	struct batch b;
+	double start, loaded, ran, total = 0;
+	INT_STAT status;
+	size_t i, len;
+	int t;
+
+	b.jobs = NULL;
+	b.njobs = 0;
+	b.units = NULL;
+	b.nunits = 0;
+	b.bits = bits;
+	b.engine = engine;
+	b.eof = eof;
+	b.steps = steps;
+	b.seconds = seconds;
+	b.tape = tape;
+	b.ranges = NULL;
+	*failed = 0;
+
+	status = read_file(fp, &text, &len);
+	if (status == INT_SUCC)
+		status = parse(&b, text);
+	if (status == INT_SUCC)
+		status = units(&b);
+	if (status != INT_SUCC)
+		goto done;
+
+	b.threads = threads ? threads : default_threads();
+#ifndef BATCH_THREADS
+	b.threads = 1;
+#endif
+	if (b.njobs && (size_t) b.threads > b.njobs)
+		b.threads = (int) b.njobs;
+
+	b.ranges = (struct range *) malloc(b.threads * sizeof(struct range));
+	workers = (struct worker *) malloc(b.threads * sizeof(struct worker));
+	if (!b.ranges || !workers) {
+		status = INT_MEMERR;
+		goto done;
+	}
+	for (t = 0; t < b.threads; ++t) {
+#ifdef BATCH_THREADS
+		pthread_mutex_init(&b.ranges[t].lock, NULL);
+#endif
+		workers[t].batch = &b;
+		workers[t].id = t;
+		workers[t].ctx = NULL;
+	}
+
+	start = io_time();
+	pool_run(&b, workers, b.nunits, load);
+	loaded = io_time();
+	pool_run(&b, workers, b.njobs, run);
+	ran = io_time();
+
+	for (i = 0; i < b.njobs; ++i) {
+		struct job *job = &b.jobs[i];
+
+		if (strcmp(job->status, "ok"))
+			++*failed;
+		total += job->time;
+		printf("%lu\t%s\t%lu\t%08lx\t%.6f\t%s\t%s\n",
+		       (unsigned long) i + 1, job->status,
+		       (unsigned long) job->bytes, job->hash, job->time,
+		       job->src, job->in ? job->in : "-");
+	}
+	if (fflush(stdout))
+		status = INT_IOERR;
+
+	fprintf(stderr, "batch: %lu jobs on %d thread%s, %lu failed\n",
+		(unsigned long) b.njobs, b.threads, b.threads == 1 ? "" : "s",
+		(unsigned long) *failed);
+	fprintf(stderr, "batch: %lu sources and %lu inputs loaded in %.6f s\n",
+		(unsigned long) b.nprogs,
+		(unsigned long) (b.nunits - b.nprogs), loaded - start);
+	fprintf(stderr, "batch: %.6f s running, %.6f s in jobs altogether\n",
+		ran - loaded, total);
+
+	for (t = 0; t < b.threads; ++t) {
+		bf_ctx_free(workers[t].ctx);
+#ifdef BATCH_THREADS
+		pthread_mutex_destroy(&b.ranges[t].lock);
+#endif
+	}
+
+done:
+	for (i = 0; i < b.nunits; ++i) {
+		bf_free(b.units[i].prog);
+		free(b.units[i].data);
+	}
+	free(workers);
+	free(b.ranges);
+	free(b.units);
+	free(b.jobs);
+	free(text);
+
+	return status;
+}
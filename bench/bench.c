@@ -0,0 +1,407 @@
+/*
+ * bench: Runs the programs in this directory on every engine of
+ * a bf binary and reports how long each run took, how many
+ * brainfuck commands per second that comes to and the peak
+ * resident memory of the run.
+ *
+ * The number of commands a workload executes is counted once, by
+ * the plain reference interpreter below, which also works out a
+ * hash of the output each run has to reproduce. Inputs are made
+ * up on the spot from a fixed seed, so every run sees the same
+ * bytes without any large files in the repository.
+ *
+ * usage: bench BF DIR [ENGINE...]
+ */
+
+#define _POSIX_C_SOURCE 200809L
+#define _DEFAULT_SOURCE		/* for wait4() */
+
+#include <sys/resource.h>
+#include <sys/time.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+enum { IN_NONE, IN_BYTES, IN_TEXT };
+
+struct workload {
+	const char *file;
+	int eof;		/* what , stores at the end of input */
+	int input;		/* what kind of input to make up */
+	unsigned long size;	/* and how much of it */
+};
+
+static const struct workload workloads[] = {
+	{ "long.b",	-1,	IN_NONE,	0 },
+	{ "primes.b",	-1,	IN_NONE,	0 },
+	{ "sort.b",	0,	IN_BYTES,	2000 },
+	{ "rot13.b",	-1,	IN_TEXT,	1UL << 20 },
+	{ "cat.b",	-1,	IN_BYTES,	64UL << 20 }
+};
+
+static const char *const engines[] = { "switch", "threaded", "jit", NULL };
+
+#define NWORKLOADS (sizeof(workloads) / sizeof(workloads[0]))
+
+/* what the reference interpreter found out about a workload */
+struct result {
+	double count;		/* commands executed */
+	unsigned long hash;	/* hash of the output */
+};
+
+static unsigned long hash_bytes(unsigned long h, const unsigned char *s,
+				size_t len)
+{
+	while (len--)
+		h = (h ^ *s++) * 16777619UL & 0xffffffffUL;
+
+	return h;
+}
+
+#define HASH_INIT 2166136261UL
+
+/*
+ * Makes up the input for a workload. Bytes are never 0 or 255,
+ * since those end the input early for sort.b and cat.b.
+ *
+ * returns: the input, or NULL for bad memory allocation
+ */
+static unsigned char *make_input(const struct workload *w)
+{
+	static const char text[] =
+		"The quick brown fox jumps over the lazy dog. 0123456789\n";
+	unsigned long seed = 12345, i;
+	unsigned char *buf;
+
+	buf = (unsigned char *) malloc(w->size ? w->size : 1);
+	if (!buf)
+		return NULL;
+
+	for (i = 0; i < w->size; ++i) {
+		seed = (seed * 1103515245UL + 12345) & 0x7fffffffUL;
+		if (w->input == IN_TEXT)
+			buf[i] = text[(seed >> 16) % (sizeof(text) - 1)];
+		else
+			buf[i] = (unsigned char) ((seed >> 16) % 254 + 1);
+	}
+
+	return buf;
+}
+
+/* a command of the reference interpreter */
+struct cmd {
+	char c;		/* the command itself, or 'z' for [-] and [+] */
+	size_t n;	/* how many times it repeats, or its match */
+};
+
+/*
+ * Runs a program the slow and obvious way, counting every command
+ * it executes. Runs of + - < > are folded, and so are [-] and
+ * [+], but they count as many commands as running them one at a
+ * time would.
+ *
+ * args: program, its length, input, its length, EOF value,
+ *       result to fill in
+ * returns: 0 for success, nonzero if the program is broken or
+ *          memory ran out
+ */
+static int reference(const char *src, size_t len, const unsigned char *in,
+		     size_t inlen, int eof, struct result *res)
+{
+	size_t *stack, depth = 0, ncmds = 0, i, j, n;
+	size_t pos = 0, tlen = 1 << 16, p = tlen / 2, outlen = 0;
+	unsigned char *tape, out[4096], v;
+	struct cmd *cmds;
+	double count = 0;
+	int ret = 1;
+
+	cmds = (struct cmd *) malloc((len + 1) * sizeof(struct cmd));
+	stack = (size_t *) malloc((len + 1) * sizeof(size_t));
+	tape = (unsigned char *) calloc(tlen, 1);
+	if (!cmds || !stack || !tape)
+		goto out;
+
+	for (i = 0; i < len; ++i) {
+		switch (src[i]) {
+		case '+':
+		case '-':
+		case '>':
+		case '<':
+			for (n = 1; i + n < len && src[i + n] == src[i]; ++n)
+				;
+			cmds[ncmds].c = src[i];
+			cmds[ncmds++].n = n;
+			i += n - 1;
+			break;
+		case '.':
+		case ',':
+			cmds[ncmds].c = src[i];
+			cmds[ncmds++].n = 1;
+			break;
+		case '[':
+			if (i + 2 < len && src[i + 2] == ']' &&
+			    (src[i + 1] == '-' || src[i + 1] == '+')) {
+				cmds[ncmds].c = 'z';
+				cmds[ncmds++].n = src[i + 1] == '-';
+				i += 2;
+				break;
+			}
+			stack[depth++] = ncmds;
+			cmds[ncmds++].c = '[';
+			break;
+		case ']':
+			if (!depth)
+				goto out;
+			j = stack[--depth];
+			cmds[j].n = ncmds;
+			cmds[ncmds].c = ']';
+			cmds[ncmds++].n = j;
+			break;
+		}
+	}
+	if (depth)
+		goto out;
+
+	res->hash = HASH_INIT;
+
+	for (i = 0; i < ncmds; ++i) {
+		switch (cmds[i].c) {
+		case '+':
+			tape[p] += (unsigned char) cmds[i].n;
+			count += cmds[i].n;
+			break;
+		case '-':
+			tape[p] -= (unsigned char) cmds[i].n;
+			count += cmds[i].n;
+			break;
+		case '>':
+			p += cmds[i].n;
+			count += cmds[i].n;
+			if (p >= tlen)
+				goto out;
+			break;
+		case '<':
+			if (p < cmds[i].n)
+				goto out;
+			p -= cmds[i].n;
+			count += cmds[i].n;
+			break;
+		case 'z':
+			/* [ once, then - and ] for every time round */
+			v = cmds[i].n ? tape[p] : (unsigned char) -tape[p];
+			count += 1 + 2.0 * v;
+			tape[p] = 0;
+			break;
+		case '.':
+			++count;
+			out[outlen++] = tape[p];
+			if (outlen == sizeof(out)) {
+				res->hash = hash_bytes(res->hash, out, outlen);
+				outlen = 0;
+			}
+			break;
+		case ',':
+			++count;
+			if (pos < inlen)
+				tape[p] = in[pos++];
+			else
+				tape[p] = (unsigned char) eof;
+			break;
+		case '[':
+			++count;
+			if (!tape[p])
+				i = cmds[i].n;
+			break;
+		case ']':
+			++count;
+			if (tape[p])
+				i = cmds[i].n;
+			break;
+		}
+	}
+
+	res->hash = hash_bytes(res->hash, out, outlen);
+	res->count = count;
+	ret = 0;
+
+out:
+	free(cmds);
+	free(stack);
+	free(tape);
+	return ret;
+}
+
+/* reads a whole file, returns NULL if it can't */
+static char *slurp(const char *path, size_t *len)
+{
+	FILE *fp = fopen(path, "rb");
+	char *buf = NULL, *tmp;
+	size_t cap = 0, n;
+
+	if (!fp)
+		return NULL;
+
+	*len = 0;
+	do {
+		cap = cap ? cap * 2 : 4096;
+		tmp = (char *) realloc(buf, cap);
+		if (!tmp) {
+			free(buf);
+			fclose(fp);
+			return NULL;
+		}
+		buf = tmp;
+		n = fread(buf + *len, 1, cap - *len, fp);
+		*len += n;
+	} while (*len == cap);
+
+	fclose(fp);
+	return buf;
+}
+
+/*
+ * Runs bf once with stdin and stdout redirected to the given
+ * files, and checks the output against the reference.
+ *
+ * returns: 0 if bf ran and got the right output, 1 if the output
+ *          was wrong, -1 if bf couldn't be run or failed
+ */
+static int run(const char *bf, const char *engine, const char *path,
+	       int eof, FILE *in, FILE *out, const struct result *res,
+	       double *secs, long *rss)
+{
+	char engine_opt[64], eof_opt[16];
+	struct timespec start, end;
+	struct rusage ru;
+	unsigned char buf[4096];
+	unsigned long hash = HASH_INIT;
+	size_t n;
+	pid_t pid;
+	int status;
+
+	sprintf(engine_opt, "--engine=%.50s", engine);
+	sprintf(eof_opt, "--eof=%d", eof);
+
+	rewind(in);
+	rewind(out);
+	if (ftruncate(fileno(out), 0))
+		return -1;
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+
+	pid = fork();
+	if (pid < 0)
+		return -1;
+	if (!pid) {
+		if (dup2(fileno(in), 0) < 0 || dup2(fileno(out), 1) < 0)
+			_exit(127);
+		execl(bf, bf, engine_opt, eof_opt, path, (char *) NULL);
+		_exit(127);
+	}
+
+	if (wait4(pid, &status, 0, &ru) != pid)
+		return -1;
+
+	clock_gettime(CLOCK_MONOTONIC, &end);
+
+	if (!WIFEXITED(status) || WEXITSTATUS(status))
+		return -1;
+
+	*secs = (end.tv_sec - start.tv_sec) +
+		(end.tv_nsec - start.tv_nsec) / 1e9;
+	*rss = ru.ru_maxrss;
+
+	rewind(out);
+	while ((n = fread(buf, 1, sizeof(buf), out)))
+		hash = hash_bytes(hash, buf, n);
+
+	return hash != res->hash;
+}
+
+int main(int argc, char *argv[])
+{
+	const char *const *engine, *const *list = engines;
+	struct result res;
+	unsigned char *input;
+	char path[4096], *src;
+	size_t len = 0, i;
+	FILE *in, *out;
+	double secs;
+	long rss;
+	int status, ret = EXIT_SUCCESS;
+
+	if (argc < 3) {
+		printf("usage: %s BF DIR [ENGINE...]\n", argv[0]);
+		return EXIT_FAILURE;
+	}
+
+	if (argc > 3)
+		list = (const char *const *) argv + 3;
+
+	in = tmpfile();
+	out = tmpfile();
+	if (!in || !out) {
+		printf("%s: error: could not create temporary files\n",
+		       argv[0]);
+		return EXIT_FAILURE;
+	}
+
+	printf("%-10s %-9s %9s %12s %10s\n",
+	       "workload", "engine", "time (s)", "Mcommand/s", "RSS (KiB)");
+
+	for (i = 0; i < NWORKLOADS; ++i) {
+		const struct workload *w = &workloads[i];
+
+		sprintf(path, "%.4000s/%s", argv[2], w->file);
+
+		src = slurp(path, &len);
+		input = make_input(w);
+		if (!src || !input) {
+			printf("%-10s could not be loaded\n", w->file);
+			ret = EXIT_FAILURE;
+			free(src);
+			free(input);
+			continue;
+		}
+
+		rewind(in);
+		if (ftruncate(fileno(in), 0) ||
+		    fwrite(input, 1, w->size, in) != w->size ||
+		    fflush(in) ||
+		    reference(src, len, input, w->size, w->eof, &res)) {
+			printf("%-10s could not be run\n", w->file);
+			ret = EXIT_FAILURE;
+			free(src);
+			free(input);
+			continue;
+		}
+
+		free(src);
+		free(input);
+
+		for (engine = list; *engine; ++engine) {
+			status = run(argv[1], *engine, path, w->eof, in, out,
+				     &res, &secs, &rss);
+			if (status < 0) {
+				printf("%-10s %-9s failed\n", w->file, *engine);
+				ret = EXIT_FAILURE;
+				continue;
+			}
+
+			printf("%-10s %-9s %9.3f %12.1f %10ld%s\n", w->file,
+			       *engine, secs, res.count / secs / 1e6, rss,
+			       status ? "  wrong output" : "");
+			if (status)
+				ret = EXIT_FAILURE;
+		}
+	}
+
+	fclose(in);
+	fclose(out);
+
+	return ret;
+}
@@ -0,0 +1,4 @@
+Copies stdin to stdout a byte at a time until the end of input
+which is read as minus one
+
+,+[-.,+]
@@ -0,0 +1,221 @@
+/*
+ * damaged: Feeds a bf binary bytecode files that have been put
+ * together by hand to get past the header and the checksum, but
+ * whose instructions no compiler would write, and checks that it
+ * turns every one of them down with an error on every engine,
+ * rather than crashing or running forever.
+ *
+ * A good file is run first, to show the files are made right and
+ * it's only what's in them that's wrong.
+ *
+ * usage: damaged BF
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <sys/resource.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "../bfint.h"
+
+#define CPU_SECONDS 5	/* longer than any of these should take */
+#define HEAD_SIZE 32
+#define RECORD_SIZE 16
+#define MAX_OPS 8
+
+struct file {
+	const char *name;
+	int good;		/* whether bf should run it */
+	size_t len;
+	struct op ops[MAX_OPS];
+};
+
+static const struct file files[] = {
+	{ "good", 1, 3,
+	  { { OP_IN, 0, 0 }, { OP_OUT, 0, 0 }, { OP_END, 0, 0 } } },
+	{ "scan-zero", 0, 4,
+	  { { OP_IN, 0, 0 }, { OP_SCAN, 0, 0 }, { OP_OUT, 0, 0 },
+	    { OP_END, 0, 0 } } },
+	{ "move-least", 0, 3,
+	  { { OP_MOVE, 0, LONG_MIN }, { OP_OUT, 0, 0 }, { OP_END, 0, 0 } } },
+	{ "move-most", 0, 3,
+	  { { OP_MOVE, 0, LONG_MAX }, { OP_OUT, 0, 0 }, { OP_END, 0, 0 } } },
+	{ "scan-least", 0, 4,
+	  { { OP_IN, 0, 0 }, { OP_SCAN, 0, LONG_MIN }, { OP_OUT, 0, 0 },
+	    { OP_END, 0, 0 } } }
+};
+
+static const char *const engines[] = {
+	"--engine=switch", "--engine=threaded", "--jit", NULL
+};
+
+#define NFILES (sizeof(files) / sizeof(files[0]))
+
+static void put_le(unsigned char *p, unsigned long v, int n)
+{
+	while (n--) {
+		*p++ = (unsigned char) (v & 0xff);
+		v >>= 8;
+	}
+}
+
+/* the same layout as bytecode.c writes, checksum and all */
+static int write_file(const char *path, const struct file *f)
+{
+	unsigned char head[HEAD_SIZE], rec[MAX_OPS][RECORD_SIZE];
+	unsigned long a = 0, b = 0, arg;
+	size_t i, j;
+	FILE *fp;
+	int bad;
+
+	for (i = 0; i < f->len; ++i) {
+		arg = (unsigned long) f->ops[i].arg;
+		put_le(rec[i], (unsigned long) f->ops[i].kind, 4);
+		put_le(rec[i] + 4, (unsigned long) f->ops[i].off, 4);
+		put_le(rec[i] + 8, arg, sizeof(long) < 8 ? sizeof(long) : 8);
+		for (j = sizeof(long); j < 8; ++j)
+			rec[i][8 + j] = f->ops[i].arg < 0 ? 0xff : 0;
+		for (j = 0; j < RECORD_SIZE; j += 4) {
+			a += rec[i][j] | rec[i][j + 1] << 8 |
+			     (unsigned long) rec[i][j + 2] << 16 |
+			     (unsigned long) rec[i][j + 3] << 24;
+			b += a;
+		}
+	}
+
+	memset(head, 0, HEAD_SIZE);
+	memcpy(head, "bfbc", 4);
+	put_le(head + 4, 1, 4);
+	put_le(head + 8, 8, 4);
+	put_le(head + 16, (unsigned long) f->len, 4);
+	put_le(head + 24, a & 0xffffffffUL, 4);
+	put_le(head + 28, b & 0xffffffffUL, 4);
+
+	fp = fopen(path, "wb");
+	if (!fp)
+		return 1;
+	bad = fwrite(head, 1, HEAD_SIZE, fp) != HEAD_SIZE ||
+	      fwrite(rec, RECORD_SIZE, f->len, fp) != f->len;
+
+	return fclose(fp) || bad;
+}
+
+/*
+ * Runs a command with stdin and stdout redirected.
+ *
+ * returns: its exit status, 128 plus the signal if it was killed
+ *          by one, or -1 if it couldn't be run
+ */
+static int spawn(char *const argv[], const char *in, const char *out)
+{
+	struct rlimit rl;
+	pid_t pid;
+	int status, fd;
+
+	pid = fork();
+	if (pid < 0)
+		return -1;
+	if (!pid) {
+		rl.rlim_cur = rl.rlim_max = CPU_SECONDS;
+		setrlimit(RLIMIT_CPU, &rl);
+		fd = open(in, O_RDONLY);
+		if (fd < 0 || dup2(fd, 0) < 0)
+			_exit(127);
+		fd = open(out, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+		if (fd < 0 || dup2(fd, 1) < 0)
+			_exit(127);
+		execvp(argv[0], argv);
+		_exit(127);
+	}
+
+	if (waitpid(pid, &status, 0) != pid)
+		return -1;
+	if (WIFSIGNALED(status))
+		return 128 + WTERMSIG(status);
+
+	return WIFEXITED(status) ? WEXITSTATUS(status) : -1;
+}
+
+/* reads up to len - 1 bytes of a file into a string */
+static void slurp(const char *path, char *s, size_t len)
+{
+	FILE *fp = fopen(path, "rb");
+	size_t n = 0;
+
+	if (fp) {
+		n = fread(s, 1, len - 1, fp);
+		fclose(fp);
+	}
+	s[n] = '\0';
+}
+
+int main(int argc, char *argv[])
+{
+	char dir[] = "/tmp/bf-damaged.XXXXXX";
+	char prog[64], in[64], out[64], got[256];
+	const char *want = "error: not a valid bytecode file";
+	char *args[5];
+	size_t f, e;
+	int rc, wrong = 0;
+	FILE *fp;
+
+	if (argc != 2) {
+		printf("usage: %s BF\n", argv[0]);
+		return EXIT_FAILURE;
+	}
+
+	if (!mkdtemp(dir)) {
+		perror(dir);
+		return EXIT_FAILURE;
+	}
+	sprintf(in, "%s/in", dir);
+	sprintf(out, "%s/out", dir);
+	fp = fopen(in, "wb");
+	if (!fp || fputs("x", fp) == EOF || fclose(fp)) {
+		perror(in);
+		return EXIT_FAILURE;
+	}
+
+	for (f = 0; f < NFILES; ++f) {
+		sprintf(prog, "%s/%s", dir, files[f].name);
+		if (write_file(prog, &files[f])) {
+			perror(prog);
+			return EXIT_FAILURE;
+		}
+
+		for (e = 0; engines[e]; ++e) {
+			args[0] = argv[1];
+			args[1] = (char *) engines[e];
+			args[2] = (char *) "--run-bytecode";
+			args[3] = prog;
+			args[4] = NULL;
+
+			rc = spawn(args, in, out);
+			slurp(out, got, sizeof(got));
+			if (files[f].good ? rc || strcmp(got, "x")
+			    : rc != EXIT_FAILURE ||
+			      !strstr(got, want)) {
+				printf("%-10s  %-17s  exit %d: %s\n",
+				       files[f].name, engines[e], rc, got);
+				++wrong;
+			}
+		}
+		remove(prog);
+	}
+
+	remove(in);
+	remove(out);
+	rmdir(dir);
+
+	printf("%lu files on %lu engines, %d came out wrong\n",
+	       (unsigned long) NFILES, (unsigned long) e, wrong);
+
+	return wrong ? EXIT_FAILURE : EXIT_SUCCESS;
+}
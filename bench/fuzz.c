@@ -0,0 +1,796 @@
+/*
+ * fuzz: Makes up random brainfuck programs, runs every one of them
+ * on every engine of a bf binary and checks that they all come out
+ * the same. How long each run took goes into a table of the kinds
+ * of program against the engines, to show which engine wins where.
+ *
+ * Every program ends by printing the cells either side of where it
+ * left the pointer, so what's left on the tape is compared along
+ * with the output. A plain reference interpreter runs each program
+ * first, for up to REF_COMMANDS commands. A program that finishes
+ * in that has to come out exactly the same on every engine, the
+ * generated C and assembly included. One that doesn't is run with
+ * --max-steps, and then all that can be checked is that every
+ * engine stopped in the same place, with the same output, as the
+ * first one did, which leaves out the generated code, see struct
+ * engine.
+ *
+ * Program number i is made up from seed SEED + i alone, so a
+ * program that comes out wrong can be made again with fuzz BF 1
+ * and its own seed. It's also left in fuzz-SEED.b, with its input
+ * in fuzz-SEED.in.
+ *
+ * usage: fuzz BF RUNS SEED [ENGINE...]
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <sys/resource.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#define REF_COMMANDS 10000000L	/* most commands the reference runs */
+#define REF_CELLS (1L << 16)	/* cells either side of where it starts */
+#define MAX_STEPS "--max-steps=1000000"
+#define MAX_TAPE "--max-tape=67108864"
+#define CPU_SECONDS 20	/* most CPU time a run can take */
+#define DUMP_CELLS 16	/* cells printed either side of the pointer */
+
+/* how an engine is run */
+enum { RUN_BF, RUN_BYTECODE, RUN_C, RUN_ASM };
+
+/*
+ * An engine to try. steps is whether --max-steps stops it in the
+ * same place as the others, which it does everywhere but in the
+ * generated code, since that has no limits.
+ */
+struct engine {
+	const char *name;
+	int how;
+	int steps;
+	const char *opt[2];	/* options for bf, if any */
+};
+
+static const struct engine engines[] = {
+	{ "switch",	RUN_BF,		1, { "--engine=switch", NULL } },
+	{ "threaded",	RUN_BF,		1, { "--engine=threaded", NULL } },
+	{ "profile",	RUN_BF,		1, { "--profile", NULL } },
+	{ "guard",	RUN_BF,		1, { "--guard", NULL } },
+	{ "jit",	RUN_BF,		1, { "--jit", "--jit-after=0" } },
+	{ "tiered",	RUN_BF,		1, { "--jit", "--jit-after=100" } },
+	{ "bytecode",	RUN_BYTECODE,	1, { NULL, NULL } },
+	{ "c",		RUN_C,		0, { NULL, NULL } },
+	{ "asm",	RUN_ASM,	0, { NULL, NULL } }
+};
+
+#define NENGINES (sizeof(engines) / sizeof(engines[0]))
+
+/* the kinds of program made up, which the table is split into */
+enum { STYLE_FLAT, STYLE_LOOPS, STYLE_SCAN, STYLE_INPUT, STYLE_WILD };
+
+static const char *const styles[] = {
+	"flat", "loops", "scan", "input", "wild"
+};
+
+#define NSTYLES (sizeof(styles) / sizeof(styles[0]))
+
+/* what , stores at the end of input, as bf's --eof takes it */
+static const char *const eofs[] = {
+	"--eof=0", "--eof=-1", "--eof=unchanged"
+};
+
+/* a program being made up, and the state of its generator */
+struct gen {
+	char *buf;
+	size_t len;
+	size_t cap;
+	unsigned long seed;
+	int style;
+	long off;	/* where the pointer is, from where it started */
+	long counter;	/* where the innermost loop's counter is */
+	int failed;	/* nonzero once memory has run out */
+};
+
+static unsigned rnd(struct gen *g, unsigned n)
+{
+	g->seed = (g->seed * 1103515245UL + 12345) & 0x7fffffffUL;
+
+	return (unsigned) ((g->seed >> 16) % n);
+}
+
+/* appends n of c */
+static void put(struct gen *g, int c, size_t n)
+{
+	char *buf;
+
+	if (g->len + n + 1 > g->cap) {
+		while (g->len + n + 1 > g->cap)
+			g->cap = g->cap ? g->cap * 2 : 256;
+		buf = (char *) realloc(g->buf, g->cap);
+		if (!buf) {
+			g->failed = 1;
+			return;
+		}
+		g->buf = buf;
+	}
+
+	memset(g->buf + g->len, c, n);
+	g->len += n;
+	g->buf[g->len] = '\0';
+}
+
+static void puts_gen(struct gen *g, const char *s)
+{
+	while (*s)
+		put(g, *s++, 1);
+}
+
+/* moves the pointer n cells, either way */
+static void move(struct gen *g, long n)
+{
+	put(g, n < 0 ? '<' : '>', (size_t) labs(n));
+	g->off += n;
+}
+
+static void block(struct gen *g, int depth, unsigned items);
+
+/*
+ * A loop that counts its cell down and works on others, so it
+ * stands a chance of finishing, and ends up where it started, or
+ * now and then one that does neither.
+ */
+static void loop(struct gen *g, int depth)
+{
+	long start = g->off, counter = g->counter;
+
+	put(g, '[', 1);
+	if (rnd(g, 8)) {
+		put(g, '-', 1);
+		g->counter = start;
+		move(g, 1 + rnd(g, 3));
+	}
+	block(g, depth + 1, 1 + rnd(g, 5));
+	if (rnd(g, 8))
+		move(g, start - g->off);
+	put(g, ']', 1);
+	g->counter = counter;
+}
+
+/* [->++>>+<<<] and the like, which should become MULs */
+static void mul_loop(struct gen *g)
+{
+	long start = g->off;
+	unsigned i, n = 1 + rnd(g, 4);
+
+	puts_gen(g, rnd(g, 3) ? "[-" : "[+");
+	for (i = 0; i < n; ++i) {
+		move(g, (long) rnd(g, 11) - 5);
+		put(g, rnd(g, 2) ? '+' : '-', 1 + rnd(g, 5));
+	}
+	if (rnd(g, 10))
+		move(g, start - g->off);
+	put(g, ']', 1);
+}
+
+/* sets a counter next door and runs a loop on it */
+static void counted_loop(struct gen *g, int depth)
+{
+	long counter = g->counter;
+
+	move(g, 1);
+	put(g, '+', 1 + rnd(g, 12));
+	g->counter = g->off;
+	put(g, '[', 1);
+	move(g, -1);
+	block(g, depth + 1, 1 + rnd(g, 4));
+	move(g, g->counter - g->off);
+	puts_gen(g, "-]");
+	move(g, -1);
+	g->counter = counter;
+}
+
+/*
+ * Appends a number of bits of program. Which bits are likely
+ * depends on the style, and loops only nest so deep. Nothing
+ * changes the counter of the loop it's in, unless a scan has
+ * left the pointer somewhere else than where it's thought to be.
+ */
+static void block(struct gen *g, int depth, unsigned items)
+{
+	/* how likely each bit is in each style, out of their sum */
+	static const unsigned char weights[][10] = {
+		/* add move . , clear scan mul count loop text */
+		{ 8, 6, 3, 0, 2, 0, 1, 0, 0, 2 },	/* flat */
+		{ 4, 3, 1, 0, 1, 0, 3, 3, 2, 1 },	/* loops */
+		{ 4, 2, 1, 0, 1, 4, 1, 1, 1, 1 },	/* scan */
+		{ 3, 2, 3, 4, 1, 0, 1, 1, 1, 1 },	/* input */
+		{ 3, 3, 2, 1, 1, 1, 2, 2, 4, 1 }	/* wild */
+	};
+	static const char *const scans[] = { "[>]", "[<]", "[>>]", "[<<<]" };
+	static const char *const text = "bf fuzz\nabc XYZ 123\t";
+	const unsigned char *w = weights[g->style];
+	unsigned i, k, r, sum = 0;
+
+	for (k = 0; k < 10; ++k)
+		sum += w[k];
+
+	for (i = 0; i < items && !g->failed; ++i) {
+		r = rnd(g, sum);
+		for (k = 0; r >= w[k]; ++k)
+			r -= w[k];
+		if (depth > 2 && k >= 6 && k <= 8)
+			k = 0;
+		if ((g->off == g->counter && k != 1 && k != 2 && k != 5) ||
+		    (g->off + 1 == g->counter && k == 7))
+			k = 1;
+
+		switch (k) {
+		case 0:
+			/* near 256 now and then, to wrap cells around */
+			put(g, rnd(g, 2) ? '+' : '-', rnd(g, 8)
+				? 1 + rnd(g, 10) : 250 + rnd(g, 12));
+			break;
+		case 1:
+			/* and far enough now and then not to fuse */
+			move(g, (rnd(g, 2) ? 1 : -1) * (long) (rnd(g, 10)
+				? 1 + rnd(g, 4) : 250 + rnd(g, 20)));
+			break;
+		case 2:
+			put(g, '.', 1);
+			break;
+		case 3:
+			puts_gen(g, rnd(g, 3) ? "," : ",.");
+			break;
+		case 4:
+			puts_gen(g, rnd(g, 4) ? "[-]" : rnd(g, 2) ? "[+]"
+							    : "[---]");
+			break;
+		case 5:
+			puts_gen(g, scans[rnd(g, 4)]);
+			break;
+		case 6:
+			mul_loop(g);
+			break;
+		case 7:
+			counted_loop(g, depth);
+			break;
+		case 8:
+			loop(g, depth);
+			break;
+		default:
+			put(g, text[rnd(g, (unsigned) strlen(text))], 1);
+			break;
+		}
+	}
+}
+
+/*
+ * Makes up a program and its input from a seed.
+ *
+ * args: seed, generator to fill in, where to put the input and
+ *       its size, which has room for 256 bytes
+ * returns: 0 for success, nonzero for bad memory allocation
+ */
+static int generate(unsigned long seed, struct gen *g, unsigned char *in,
+		    size_t *inlen)
+{
+	size_t i;
+
+	g->len = 0;
+	g->seed = seed;
+	g->off = 0;
+	g->counter = 1;
+	g->failed = 0;
+	rnd(g, 1);
+	g->style = (int) rnd(g, NSTYLES);
+
+	block(g, 0, 4 + rnd(g, 40));
+
+	/* what's left on the tape, as output */
+	move(g, -DUMP_CELLS);
+	for (i = 0; i < 2 * DUMP_CELLS; ++i)
+		puts_gen(g, ".>");
+
+	*inlen = rnd(g, 4) ? rnd(g, 257) : 0;
+	for (i = 0; i < *inlen; ++i)
+		in[i] = (unsigned char) rnd(g, 256);
+
+	return g->failed;
+}
+
+/* output collected in memory */
+struct buf {
+	unsigned char *data;
+	size_t len;
+	size_t cap;
+};
+
+static int buf_put(struct buf *b, int c)
+{
+	unsigned char *data;
+
+	if (b->len == b->cap) {
+		b->cap = b->cap ? b->cap * 2 : 4096;
+		data = (unsigned char *) realloc(b->data, b->cap);
+		if (!data)
+			return 1;
+		b->data = data;
+	}
+	b->data[b->len++] = (unsigned char) c;
+
+	return 0;
+}
+
+/*
+ * Runs a program the slow and obvious way, for up to REF_COMMANDS
+ * commands and on REF_CELLS cells either side of where it starts.
+ * The only shortcut is [-] and [+], which count as one command.
+ *
+ * args: program, input, its size, bits in a cell, index into
+ *       eofs, where to put the output
+ * returns: 0 if it finished, 1 if it didn't or ran off the tape,
+ *          -1 for bad memory allocation
+ */
+static int reference(const char *src, const unsigned char *in,
+		     size_t inlen, int bits, int eof, struct buf *out)
+{
+	unsigned long mask = 0xffffffffUL >> (32 - bits), *tape;
+	size_t len = strlen(src), *match, *stack, depth = 0, i, pos = 0;
+	long p = REF_CELLS, count = 0;
+	int ret = -1;
+
+	tape = (unsigned long *) calloc(2 * REF_CELLS, sizeof(long));
+	match = (size_t *) malloc((len + 1) * sizeof(size_t));
+	stack = (size_t *) malloc((len + 1) * sizeof(size_t));
+	if (!tape || !match || !stack)
+		goto out;
+
+	/* the generator only makes up balanced brackets */
+	for (i = 0; i < len; ++i) {
+		if (src[i] == '[') {
+			stack[depth++] = i;
+		} else if (src[i] == ']') {
+			match[i] = stack[--depth];
+			match[match[i]] = i;
+		}
+	}
+
+	ret = 1;
+	for (i = 0; i < len; ++i) {
+		if (count++ == REF_COMMANDS)
+			goto out;
+
+		switch (src[i]) {
+		case '+':
+			tape[p] = (tape[p] + 1) & mask;
+			break;
+		case '-':
+			tape[p] = (tape[p] - 1) & mask;
+			break;
+		case '>':
+			if (++p == 2 * REF_CELLS)
+				goto out;
+			break;
+		case '<':
+			if (--p < 0)
+				goto out;
+			break;
+		case '.':
+			if (buf_put(out, (int) (tape[p] & 0xff))) {
+				ret = -1;
+				goto out;
+			}
+			break;
+		case ',':
+			if (pos < inlen)
+				tape[p] = in[pos++];
+			else if (eof < 2)
+				tape[p] = eof ? mask : 0;
+			break;
+		case '[':
+			/* a wide cell takes a while to clear one at a time */
+			if (i + 2 < len && src[i + 2] == ']' &&
+			    (src[i + 1] == '-' || src[i + 1] == '+')) {
+				tape[p] = 0;
+				i += 2;
+			} else if (!tape[p]) {
+				i = match[i];
+			}
+			break;
+		case ']':
+			if (tape[p])
+				i = match[i];
+			break;
+		}
+	}
+	ret = 0;
+
+out:
+	free(tape);
+	free(match);
+	free(stack);
+	return ret;
+}
+
+/*
+ * Runs a command with stdin and stdout redirected, and stderr
+ * thrown away, and times it.
+ *
+ * args: the command, file for stdin or NULL for none, file for
+ *       stdout, where to put the seconds it took
+ * returns: its exit status, 128 plus the signal if it was killed
+ *          by one, or -1 if it couldn't be run
+ */
+static int spawn(char *const argv[], const char *in, const char *out,
+		 double *secs)
+{
+	struct timespec start, end;
+	struct rlimit rl;
+	pid_t pid;
+	int status, fd;
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+
+	pid = fork();
+	if (pid < 0)
+		return -1;
+	if (!pid) {
+		rl.rlim_cur = rl.rlim_max = CPU_SECONDS;
+		setrlimit(RLIMIT_CPU, &rl);
+		fd = open(in ? in : "/dev/null", O_RDONLY);
+		if (fd < 0 || dup2(fd, 0) < 0)
+			_exit(127);
+		fd = open(out, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+		if (fd < 0 || dup2(fd, 1) < 0)
+			_exit(127);
+		fd = open("/dev/null", O_WRONLY);
+		if (fd < 0 || dup2(fd, 2) < 0)
+			_exit(127);
+		execvp(argv[0], argv);
+		_exit(127);
+	}
+
+	if (waitpid(pid, &status, 0) != pid)
+		return -1;
+
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	*secs = (end.tv_sec - start.tv_sec) +
+		(end.tv_nsec - start.tv_nsec) / 1e9;
+
+	if (WIFSIGNALED(status))
+		return 128 + WTERMSIG(status);
+
+	return WIFEXITED(status) ? WEXITSTATUS(status) : -1;
+}
+
+/* reads a whole file into a buffer, returns nonzero if it can't */
+static int slurp(const char *path, struct buf *b)
+{
+	FILE *fp = fopen(path, "rb");
+	int c;
+
+	b->len = 0;
+	if (!fp)
+		return 1;
+
+	while ((c = getc(fp)) != EOF)
+		if (buf_put(b, c))
+			break;
+
+	c = ferror(fp) || !feof(fp);
+	fclose(fp);
+
+	return c;
+}
+
+/* the files a run uses, in a directory of its own */
+struct files {
+	char prog[64];
+	char in[64];
+	char out[64];
+	char gen[64];	/* bytecode, C or assembly made from the program */
+	char exe[64];
+	char cell_bits[16];
+};
+
+/*
+ * Runs a program on an engine, making the bytecode or native code
+ * first if that's how it runs.
+ *
+ * args: bf, engine, files to use, index into eofs, whether to
+ *       limit the steps, where to put the seconds the run took
+ * returns: as for spawn(), or -2 if the program couldn't be made
+ *          into what the engine runs
+ */
+static int run(char *bf, const struct engine *e, const struct files *f,
+	       int eof, int limit, double *secs)
+{
+	char *argv[16], *cc = getenv("CC");
+	double t;
+	int n = 0, i;
+
+	argv[n++] = bf;
+
+	switch (e->how) {
+	case RUN_BYTECODE:
+		/* the limit decides what's compiled, see bf's README */
+		argv[n++] = (char *) f->cell_bits;
+		if (limit)
+			argv[n++] = (char *) MAX_STEPS;
+		argv[n++] = (char *) "--compile";
+		argv[n++] = (char *) f->prog;
+		argv[n] = NULL;
+		if (spawn(argv, NULL, f->gen, &t))
+			return -2;
+		n = 1;
+		argv[n++] = (char *) "--run-bytecode";
+		break;
+	case RUN_C:
+	case RUN_ASM:
+		argv[n++] = (char *) f->cell_bits;
+		argv[n++] = (char *) eofs[eof];
+		argv[n++] = (char *) (e->how == RUN_C ? "--emit-c"
+						      : "--emit-asm");
+		argv[n++] = (char *) f->prog;
+		argv[n] = NULL;
+		if (spawn(argv, NULL, f->gen, &t))
+			return -2;
+
+		n = 0;
+		argv[n++] = cc ? cc : (char *) "cc";
+		argv[n++] = (char *) "-O1";
+		argv[n++] = (char *) "-w";
+		argv[n++] = (char *) "-x";
+		argv[n++] = (char *) (e->how == RUN_C ? "c" : "assembler");
+		argv[n++] = (char *) f->gen;
+		argv[n++] = (char *) "-o";
+		argv[n++] = (char *) f->exe;
+		argv[n] = NULL;
+		if (spawn(argv, NULL, "/dev/null", &t))
+			return -2;
+
+		argv[0] = (char *) f->exe;
+		argv[1] = NULL;
+		return spawn(argv, f->in, f->out, secs);
+	default:
+		for (i = 0; i < 2 && e->opt[i]; ++i)
+			argv[n++] = (char *) e->opt[i];
+		argv[n++] = (char *) f->cell_bits;
+	}
+
+	argv[n++] = (char *) eofs[eof];
+	if (limit)
+		argv[n++] = (char *) MAX_STEPS;
+	argv[n++] = (char *) MAX_TAPE;
+	argv[n++] = (char *) (e->how == RUN_BYTECODE ? f->gen : f->prog);
+	argv[n] = NULL;
+
+	return spawn(argv, f->in, f->out, secs);
+}
+
+/* writes a program and its input where they can be run from */
+static int save(const char *prog, const char *path, const unsigned char *in,
+		size_t inlen, const char *inpath)
+{
+	FILE *fp = fopen(path, "wb");
+	int bad;
+
+	if (!fp)
+		return 1;
+	bad = fputs(prog, fp) == EOF;
+	bad |= fclose(fp) == EOF;
+
+	fp = fopen(inpath, "wb");
+	if (!fp)
+		return 1;
+	bad |= fwrite(in, 1, inlen, fp) != inlen;
+	bad |= fclose(fp) == EOF;
+
+	return bad;
+}
+
+/*
+ * A row of the table, for the programs of a style that finished or
+ * the ones that were stopped at --max-steps.
+ */
+struct row {
+	unsigned long progs;
+	unsigned long runs[NENGINES];
+	double secs[NENGINES];
+};
+
+/* the mean milliseconds a run on an engine took, or -1 for none */
+static double mean_ms(const struct row *row, size_t e)
+{
+	return row->runs[e] ? row->secs[e] * 1e3 / row->runs[e] : -1;
+}
+
+/* prints the table, marking the fastest engine in each row */
+static void print_table(struct row rows[][2], const int *use)
+{
+	double ms, best;
+	size_t s, e;
+	int stopped;
+
+	printf("\n%-6s %-7s %5s", "style", "ran", "progs");
+	for (e = 0; e < NENGINES; ++e)
+		if (use[e])
+			printf(" %9s", engines[e].name);
+	printf("\n");
+
+	for (s = 0; s < NSTYLES; ++s) {
+		for (stopped = 0; stopped < 2; ++stopped) {
+			const struct row *row = &rows[s][stopped];
+
+			if (!row->progs)
+				continue;
+
+			best = -1;
+			for (e = 0; e < NENGINES; ++e) {
+				ms = mean_ms(row, e);
+				if (use[e] && ms >= 0 &&
+				    (best < 0 || ms < best))
+					best = ms;
+			}
+
+			printf("%-6s %-7s %5lu", styles[s],
+			       stopped ? "stopped" : "to end", row->progs);
+			for (e = 0; e < NENGINES; ++e) {
+				ms = mean_ms(row, e);
+				if (!use[e])
+					continue;
+				else if (ms < 0)
+					printf(" %9s", "-");
+				else
+					printf(" %8.2f%c", ms,
+					       ms == best ? '*' : ' ');
+			}
+			printf("\n");
+		}
+	}
+
+	printf("\nmean milliseconds a run, * for the fastest; c and asm "
+	       "don't count compiling,\nand asm only runs 8-bit "
+	       "programs\n");
+}
+
+int main(int argc, char *argv[])
+{
+	static const int widths[] = { 8, 8, 16, 32 };
+	struct row rows[NSTYLES][2];
+	struct files f;
+	struct gen g;
+	struct buf want, got;
+	unsigned char in[256];
+	unsigned long seed, runs, i, bad = 0;
+	char dir[] = "/tmp/bf-fuzz.XXXXXX", path[64], inpath[64];
+	const char *first;
+	size_t inlen, e;
+	int use[NENGINES], bits, eof, finished, status, want_status, n;
+	double secs;
+
+	if (argc < 4) {
+		printf("usage: %s BF RUNS SEED [ENGINE...]\n", argv[0]);
+		return EXIT_FAILURE;
+	}
+
+	runs = strtoul(argv[2], NULL, 10);
+	seed = strtoul(argv[3], NULL, 10);
+
+	for (e = 0; e < NENGINES; ++e) {
+		use[e] = argc == 4;
+		for (n = 4; n < argc; ++n)
+			if (!strcmp(argv[n], engines[e].name))
+				use[e] = 1;
+	}
+
+	if (!mkdtemp(dir)) {
+		printf("%s: error: could not create a temporary directory\n",
+		       argv[0]);
+		return EXIT_FAILURE;
+	}
+	sprintf(f.prog, "%s/prog.b", dir);
+	sprintf(f.in, "%s/in", dir);
+	sprintf(f.out, "%s/out", dir);
+	sprintf(f.gen, "%s/gen", dir);
+	sprintf(f.exe, "%s/exe", dir);
+
+	memset(rows, 0, sizeof(rows));
+	memset(&g, 0, sizeof(g));
+	memset(&want, 0, sizeof(want));
+	memset(&got, 0, sizeof(got));
+
+	for (i = 0; i < runs; ++i, ++seed) {
+		if (generate(seed, &g, in, &inlen) ||
+		    save(g.buf, f.prog, in, inlen, f.in)) {
+			printf("%s: error: could not make up a program\n",
+			       argv[0]);
+			bad = 1;
+			break;
+		}
+
+		bits = widths[rnd(&g, 4)];
+		eof = (int) rnd(&g, 3);
+		sprintf(f.cell_bits, "--cell-bits=%d", bits);
+
+		want.len = 0;
+		finished = reference(g.buf, in, inlen, bits, eof, &want);
+		if (finished < 0) {
+			printf("%s: error: bad memory allocation\n", argv[0]);
+			bad = 1;
+			break;
+		}
+		finished = !finished;
+		want_status = finished ? 0 : -1;
+		first = finished ? "the reference" : NULL;
+
+		++rows[g.style][!finished].progs;
+
+		for (e = 0; e < NENGINES; ++e) {
+			if (!use[e] || (!finished && !engines[e].steps) ||
+			    (engines[e].how == RUN_ASM && bits != 8))
+				continue;
+
+			status = run(argv[1], &engines[e], &f, eof, !finished,
+				     &secs);
+
+			/* without an assembler for it, there's no asm */
+			if (status == -2 && engines[e].how == RUN_ASM) {
+				printf("asm isn't supported here\n");
+				use[e] = 0;
+				continue;
+			}
+
+			if (status >= 0 && slurp(f.out, &got))
+				status = -1;
+
+			if (!first) {
+				first = engines[e].name;
+				want_status = status;
+				want.len = 0;
+				if (status >= 0)
+					slurp(f.out, &want);
+			} else if (status != want_status ||
+				   got.len != want.len ||
+				   memcmp(got.data, want.data, got.len)) {
+				sprintf(path, "fuzz-%lu.b", seed);
+				sprintf(inpath, "fuzz-%lu.in", seed);
+				save(g.buf, path, in, inlen, inpath);
+				printf("seed %lu (%s %s, %s): %s exited "
+				       "%d with %lu bytes, %s %d with %lu\n",
+				       seed, f.cell_bits, eofs[eof],
+				       styles[g.style], engines[e].name,
+				       status, (unsigned long) got.len, first,
+				       want_status, (unsigned long) want.len);
+				++bad;
+				continue;
+			}
+
+			++rows[g.style][!finished].runs[e];
+			rows[g.style][!finished].secs[e] += secs;
+		}
+	}
+
+	print_table(rows, use);
+	printf("%lu programs from seed %lu, %lu came out wrong\n", i,
+	       seed - i, bad);
+
+	unlink(f.prog);
+	unlink(f.in);
+	unlink(f.out);
+	unlink(f.gen);
+	unlink(f.exe);
+	rmdir(dir);
+
+	free(g.buf);
+	free(want.data);
+	free(got.data);
+
+	return bad ? EXIT_FAILURE : EXIT_SUCCESS;
+}
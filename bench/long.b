@@ -0,0 +1,20 @@
+Nested loops that do nothing but count
+and finally print a single byte
+
+>+>+>+>+>++<[>[<+++>-
+ >>>>>
+ >+>+>+>+>++<[>[<+++>-
+   >>>>>
+   >+>+>+>+>++<[>[<+++>-
+     >>>>>
+     >+>+>+>+>++<[>[<+++>-
+       >>>>>
+       +++[->+++++<]>[-]<
+       <<<<<
+     ]<<]>[-]
+     <<<<<
+   ]<<]>[-]
+   <<<<<
+ ]<<]>[-]
+ <<<<<
+]<<]>.
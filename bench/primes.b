@@ -0,0 +1,32 @@
+Prints the primes below 256 by trial division
+The remainder is counted down one step at a time so this is
+mostly small loops and copies between cells
+
+[-]++>[-]--[>[-]+>[-]++>[-]<<<<[->>>>+>+<<<<<]>>>>>[-<<<<<+>>>>>
+]<--[>>[-]<<<[->>>+>>>+<<<<<<]>>>>>>[-<<<<<<+>>>>>>]<<[-]<<<<<<<
+[->>>>>>>+>>>+<<<<<<<<<<]>>>>>>>>>>[-<<<<<<<<<<+>>>>>>>>>>]<<[-]
+<[-<->>[-]+>>>[-]<<<<<[->>>>>+>+<<<<<<]>>>>>>[-<<<<<<+>>>>>>]<[<
+<<[-]>>>[-]]>>[-]<<<<<[->>>>>+>+<<<<<<]>>>>>>[-<<<<<<+>>>>>>]<[<
+<<<<<<[-]<<<[->>>+>>>>>>>>>+<<<<<<<<<<<<]>>>>>>>>>>>>[-<<<<<<<<<
+<<<+>>>>>>>>>>>>]<<[-]]<<<<<<]>>>>>>>>>[-]<<<<<<<<[->>>>>>>>+>+<
+<<<<<<<<]>>>>>>>>>[-<<<<<<<<<+>>>>>>>>>]<[<<<<<<<<<<<<<<[-]>>>>>
+>>>>>>>>>[-]]<<<<<<<<<<<<<+>-]>>>>>>>>>>>>>>[-]<<<<<<<<<<<<<<<<[
+->>>>>>>>>>>>>>>>+>+<<<<<<<<<<<<<<<<<]>>>>>>>>>>>>>>>>>[-<<<<<<<
+<<<<<<<<<<+>>>>>>>>>>>>>>>>>]<[>>[-]>[-]>[-]>>[-]++++++++++<[-]+
++++++++++>>[-]<<<<<<<<<<<<<<<<<<<<<<<<<[->>>>>>>>>>>>>>>>>>>>>>>
+>>+>+<<<<<<<<<<<<<<<<<<<<<<<<<<]>>>>>>>>>>>>>>>>>>>>>>>>>>[-<<<<
+<<<<<<<<<<<<<<<<<<<<<<+>>>>>>>>>>>>>>>>>>>>>>>>>>]<[-<<<+>>->>>[
+-]+>[-]<<<<[->>>>+>+<<<<<]>>>>>[-<<<<<+>>>>>]<[<[-]>[-]]<[<<<[-]
+++++++++++<<[-]<+>>->>>>>>>[-]+>[-]<<<<<<<<[->>>>>>>>+>+<<<<<<<<
+<]>>>>>>>>>[-<<<<<<<<<+>>>>>>>>>]<[<[-]>[-]]<[<<<<<<<[-]++++++++
+++<<[-]<+>>>>>>>>>>[-]]<<<[-]]<<]>>>>>>>>[-]>[-]<<<<<<<<<<<<<<[-
+>>>>>>>>>>>>>>+>+<<<<<<<<<<<<<<<]>>>>>>>>>>>>>>>[-<<<<<<<<<<<<<<
+<+>>>>>>>>>>>>>>>]<[<<<<<<<<<<<<<<++++++++++++++++++++++++++++++
+++++++++++++++++++.>>>>>>>>>>>>>[-]+>[-]]>>[-]<<<<<<<<<<<<<<<[->
+>>>>>>>>>>>>>>+>+<<<<<<<<<<<<<<<<]>>>>>>>>>>>>>>>>[-<<<<<<<<<<<<
+<<<<+>>>>>>>>>>>>>>>>]<[<<<[-]+>>>[-]]>>[-]<<<<<[->>>>>+>+<<<<<<
+]>>>>>>[-<<<<<<+>>>>>>]<[<<<<<<<<<<<<<<<<<++++++++++++++++++++++
+++++++++++++++++++++++++++.>>>>>>>>>>>>>>>>>[-]]<<<<<<<<<<<<<<<<
+++++++++++++++++++++++++++++++++++++++++++++++++.>>>>>>>>>>>>>>>
+>>>[-]++++++++++.<<<<<<<<<<<<<<<<<<<<<<[-]]<<<<<<<<<<<<<<<<<<+>-
+]
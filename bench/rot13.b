@@ -0,0 +1,30 @@
+ROT13 from the Wikipedia article on brainfuck
+The end of input has to be read as minus one or leave the
+cell unchanged
+
+-,+[
+    -[
+        >>++++[>++++++++<-]
+        <+<-[
+            >+>+>-[>>>]
+            <[[>+<-]>>+>]
+            <<<<<-
+        ]
+    ]>>>[-]+
+    >--[-[<->+++[-]]]<[
+        ++++++++++++<[
+            >-[>+>>]
+            >[+[<+>-]>+>>]
+            <<<<<-
+        ]
+        >>[<+>-]
+        >[
+            -[
+                -<<[-]>>
+            ]<<[<<->>-]>>
+        ]<<[<<+>>-]
+    ]
+    <[-]
+    <.[-]
+    <-,+
+]
@@ -0,0 +1,12 @@
+Bubble sort by Daniel B Cristofani
+Sorts its input bytes until a zero or the end of input
+which has to be read as zero
+
+>>,[>>,]<<[
+[<<]>>>>[
+<<[>+<<+>-]
+>>[>+<<<<[->]>[<]>>-]
+<<<[[-]>>[>+<-]>>[<<<+>>>-]]
+>>[[<+>-]>>]<
+]<<[>>+<<-]<<
+]>>>>[.>>]
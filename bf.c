@@ -1,159 +1,62 @@
 /*
  * bf: A simple and (relatively) fast brainfuck interpreter in C.
  *
- * The reason I used a linked list instead of an array is that
- * I can expand the linked list infinitely in either direction
- * without having to destroy and recreate it each time. Based
- * on my tests, however, this seems to be somewhat less
- * performant than array-based implementations, likely because
- * it's not very cache-friendly.
+ * The tape used to be a doubly linked list, since that can be
+ * expanded infinitely in either direction without destroying
+ * and recreating it each time. That turned out to be a lot
+ * slower than array-based implementations, because it's not
+ * very cache-friendly, so the tape is now a single block of
+ * cells that doubles in size whenever the pointer runs off
+ * either end. It is still infinite in both directions, but a
+ * move is just pointer arithmetic and a cell costs one byte.
  */
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
-/*
- * This would be in stdint.h, but that was introduced in C99,
- * so we're going to define it outselves just to be safe.
- */
-#ifdef SIZE_MAX
-#undef SIZE_MAX
-#endif
-
-#define SIZE_MAX ((size_t) -1)
-
-struct node {
-	unsigned char c;
-	struct node *prev;
-	struct node *next;
-};
+#include "bf.h"
+#include "bfint.h"
 
-typedef enum { INT_SUCC, INT_INVL, INT_MEMERR, INT_IOERR } INT_STAT;
-
-/*
- * Interprets and runs brainfuck code.
- * All characters that are not brainfuck commands are ignored.
- *
- * args: pointer to first node, string to be interpreted, size of string
- * returns: 0 for success, 1 for invalid program,
- *          2 for bad memory allocation, 3 for I/O error
- */
-static INT_STAT interpret(struct node *ptr, char *str, size_t fsize)
-{
-	size_t i;
-	long bal = 0;
-
-	/*
-	 * Note that while we move i sequentially through each
-	 * instruction stored in str, it does jump around because
-	 * of the [ and ] instructions. Just think of it like the
-	 * instruction pointer and [ and ] as jmp.
-	 *
-	 * Also note that str isn't technically a C string since
-	 * it isn't null-terminated, but that's OK because we
-	 * know its size.
-	 */
+/* what bf exits with when --max-steps or --timeout stops a program */
+#define EXIT_LIMIT 2
 
-	for (i = 0; i < fsize; ++i) {
-		switch (str[i]) {
-		case '+':
-			++ptr->c;
-			break;
-		case '-':
-			--ptr->c;
-			break;
-		case '<':
-			if (!ptr->prev) {
-				/*
-				 * Before you laugh at me for casting
-				 * malloc(), I'm doing it because I
-				 * want this program to be both valid
-				 * C and C++.
-				 */
-				ptr->prev = (struct node *)
-					malloc(sizeof(struct node));
-				if (!ptr->prev)
-					return INT_MEMERR;
-				ptr->prev->c = 0;
-				ptr->prev->prev = NULL;
-				ptr->prev->next = ptr;
-			}
-			ptr = ptr->prev;
-			break;
-		case '>':
-			if (!ptr->next) {
-				ptr->next = (struct node *)
-					malloc(sizeof(struct node));
-				if (!ptr->next)
-					return INT_MEMERR;
-				ptr->next->c = 0;
-				ptr->next->prev = ptr;
-				ptr->next->next = NULL;
-			}
-			ptr = ptr->next;
-			break;
-		case '.':
-			if (putchar(ptr->c) == EOF)
-				return INT_IOERR;
-			break;
-		case ',':
-			ptr->c = getchar();
-			break;
-		case '[':
-			if (!ptr->c) {
-				bal = 1;
-				do {
-					++i;
-					if (str[i] == '[')
-						++bal;
-					if (str[i] == ']')
-						--bal;
-				} while (bal && i < fsize - 1);
-			}
-			break;
-		case ']':
-			if (ptr->c) {
-				bal = 1;
-				do {
-					--i;
-					/*
-					 * some evil programs
-					 * could cause i to
-					 * underflow here
-					 */
-					if (i >= fsize)
-						return INT_INVL;
-					if (str[i] == ']')
-						++bal;
-					if (str[i] == '[')
-						--bal;
-				} while (bal);
-			}
-			break;
-		default:
-			break; /* nothing */
-		}
-	}
-
-	/* the program is invalid if all brackets don't match at the end */
-	return bal ? INT_INVL : INT_SUCC;
-}
-
-#define ERROR(msg) \
+#define FAIL(msg, code) \
 	do { \
 		printf("%s: error: %s\n", argv[0], msg); \
-		ret = EXIT_FAILURE; \
+		ret = code; \
 		goto cleanup; \
 	} while (0)
 
+#define ERROR(msg) FAIL(msg, EXIT_FAILURE)
+
 int main(int argc, char *argv[])
 {
-	struct node *ptr, *tmp;
+	struct tape tape;
 	FILE *fp;
-	long fsize;
-	char *str = NULL;
+	char *path = NULL;
+	struct source src;
+	struct program prog;
+	struct jit *jit = NULL;
+	struct io io;
+	struct stats stats;
+	struct cache cache;
+	struct limit limit;
+	struct checkpoint ck;
+	FILE *ck_fp;
+	char *ck_path = NULL, *resume = NULL;
+	double start, max_steps = -1, timeout = 0, max_tape = 0, every = 0;
+	double hot = -1;
 	INT_STAT status;
-	int ret = EXIT_SUCCESS;
+	int i, engine = 't', emit = 0, profile = 0, ret = EXIT_SUCCESS;
+	int want_stats = 0, guard = 0, bits = 0, use_cache = 0, cached = 0;
+	int from_bytecode = 0, batch = 0, threads = 0, ahead, n;
+	size_t failed;
+	char *end;
+	struct bytecode bc;
+	const struct engines *engines;
+	int threaded;
+	int buffered = io_buffered(), eof = -1;
 
 	/*
 	 * These first few error checks don't use the
@@ -162,72 +65,434 @@ int main(int argc, char *argv[])
 	 * file pointer is a no-no.
 	 */
 
-	if (setvbuf(stdout, NULL, _IONBF, 0)) {
-		printf("%s: error: could not unbuffer stdout\n", argv[0]);
+	for (i = 1; i < argc; ++i) {
+		if (!strcmp(argv[i], "--jit") || !strcmp(argv[i], "--engine=jit"))
+			engine = 'j';
+		else if (!strcmp(argv[i], "--engine=threaded"))
+			engine = 't';
+		else if (!strcmp(argv[i], "--engine=switch"))
+			engine = 's';
+		else if (!strcmp(argv[i], "--emit-c"))
+			emit = 'c';
+		else if (!strcmp(argv[i], "--emit-asm"))
+			emit = 's';
+		else if (!strcmp(argv[i], "--compile"))
+			emit = 'b';
+		else if (!strcmp(argv[i], "--run-bytecode"))
+			from_bytecode = 1;
+		else if (!strcmp(argv[i], "--batch"))
+			batch = 1;
+		else if (!strncmp(argv[i], "--threads=", 10)) {
+			threads = (int) strtol(argv[i] + 10, &end, 10);
+			if (*end || end == argv[i] + 10 || threads < 1 ||
+			    threads > BATCH_THREADS_MAX)
+				break;
+		}
+		else if (!strncmp(argv[i], "--jit-after=", 12)) {
+			hot = strtod(argv[i] + 12, &end);
+			if (*end || end == argv[i] + 12 || !(hot >= 0) ||
+			    hot > 1e18)
+				break;
+		}
+		else if (!strncmp(argv[i], "--max-steps=", 12)) {
+			max_steps = strtod(argv[i] + 12, &end);
+			if (*end || end == argv[i] + 12 || !(max_steps >= 0) ||
+			    max_steps > 1e18)
+				break;
+		}
+		else if (!strncmp(argv[i], "--timeout=", 10)) {
+			timeout = strtod(argv[i] + 10, &end);
+			if (*end || end == argv[i] + 10 || !(timeout > 0) ||
+			    timeout > 1e9)
+				break;
+		}
+		else if (!strncmp(argv[i], "--checkpoint=", 13) && argv[i][13])
+			ck_path = argv[i] + 13;
+		else if (!strncmp(argv[i], "--checkpoint-every=", 19)) {
+			every = strtod(argv[i] + 19, &end);
+			if (*end || end == argv[i] + 19 || !(every > 0) ||
+			    every > 1e9)
+				break;
+		}
+		else if (!strncmp(argv[i], "--resume=", 9) && argv[i][9])
+			resume = argv[i] + 9;
+		else if (!strncmp(argv[i], "--max-tape=", 11)) {
+			max_tape = strtod(argv[i] + 11, &end);
+			if (*end || end == argv[i] + 11 || !(max_tape >= 1) ||
+			    max_tape > (double) (SIZE_MAX / 2))
+				break;
+		}
+		else if (!strcmp(argv[i], "--profile"))
+			profile = 1;
+		else if (!strcmp(argv[i], "--stats"))
+			want_stats = 1;
+		else if (!strcmp(argv[i], "--guard"))
+			guard = 1;
+		else if (!strcmp(argv[i], "--cache"))
+			use_cache = 1;
+		else if (!strcmp(argv[i], "--cell-bits=8"))
+			bits = 8;
+		else if (!strcmp(argv[i], "--cell-bits=16"))
+			bits = 16;
+		else if (!strcmp(argv[i], "--cell-bits=32"))
+			bits = 32;
+		else if (!strcmp(argv[i], "--unbuffered"))
+			buffered = 0;
+		else if (!strcmp(argv[i], "--eof=unchanged"))
+			eof = IO_KEEP;
+		else if (!strcmp(argv[i], "--eof=0"))
+			eof = 0;
+		else if (!strcmp(argv[i], "--eof=-1")
+			 || !strcmp(argv[i], "--eof=255"))
+			eof = -1;
+		else if ((argv[i][0] == '-' && strcmp(argv[i], "-")) || path)
+			break;
+		else
+			path = argv[i];
+	}
+
+	if (i != argc || !path) {
+		printf("usage: %s [--engine=threaded|switch|jit | --jit | "
+		       "--emit-c | --emit-asm | --compile]\n"
+		       "\t[--jit-after=STEPS] [--run-bytecode] [--profile] "
+		       "[--stats] [--guard]\n"
+		       "\t[--cache] [--unbuffered] [--eof=unchanged|0|-1] "
+		       "[--cell-bits=8|16|32]\n"
+		       "\t[--max-steps=N] [--timeout=SECONDS] "
+		       "[--max-tape=BYTES]\n"
+		       "\t[--checkpoint=FILE] [--checkpoint-every=SECONDS] "
+		       "[--resume=FILE]\n\tSOURCEFILE\n"
+		       "       %s --batch [--threads=N] [--engine=...] "
+		       "[--eof=...] [--cell-bits=...]\n"
+		       "\t[--max-steps=...] [--timeout=...] [--max-tape=...] "
+		       "MANIFEST\n",
+		       argv[0], argv[0]);
+		printf("exits with %d if --max-steps or --timeout stopped "
+		       "the program\n", EXIT_LIMIT);
+		return EXIT_FAILURE;
+	}
+
+	if (batch && (emit || from_bytecode || profile || want_stats ||
+		      guard || use_cache || ck_path || resume)) {
+		printf("%s: error: --batch only goes with --threads, --engine, "
+		       "--eof, --cell-bits and the limits\n", argv[0]);
+		return EXIT_FAILURE;
+	}
+
+	if (!ck_path != !every) {
+		printf("%s: error: --checkpoint and --checkpoint-every go "
+		       "together\n", argv[0]);
+		return EXIT_FAILURE;
+	}
+
+	/* the counts would only cover the run since the last checkpoint */
+	if ((ck_path || resume) && (emit || profile || want_stats)) {
+		printf("%s: error: checkpoints don't go with --emit-c, "
+		       "--emit-asm, --compile, --profile or --stats\n",
+		       argv[0]);
 		return EXIT_FAILURE;
 	}
 
-	if (argc != 2) {
-		printf("usage: %s SOURCEFILE\n", argv[0]);
+	/*
+	 * When running, output is buffered by io.c if at all, so
+	 * stdio mustn't add another layer. Generated code is just
+	 * written all at once.
+	 */
+	if (!emit && !batch && setvbuf(stdout, NULL, _IONBF, 0)) {
+		printf("%s: error: could not unbuffer stdout\n", argv[0]);
 		return EXIT_FAILURE;
 	}
 
-	fp = fopen(argv[1], "r");
+	/* - is stdin, so a program can be piped in */
+	fp = strcmp(path, "-") ? fopen(path, from_bytecode ? "rb" : "r")
+			       : stdin;
 	if (!fp) {
 		printf("%s: error: could not open file\n", argv[0]);
 		return EXIT_FAILURE;
 	}
 
-	ptr = (struct node *) malloc(sizeof(struct node));
-	if (!ptr)
+	/*
+	 * Before you laugh at me for casting calloc(), I'm doing
+	 * it because I want this program to be both valid C and
+	 * C++.
+	 */
+	tape.cells = (unsigned char *) calloc(TAPE_INIT, 1);
+	tape.len = TAPE_INIT;
+	tape.origin = 0;
+	tape.base = NULL;
+	tape.mapped = 0;
+	tape.max = (size_t) max_tape;
+	tape.full = 0;
+	prog.ops = NULL;
+	prog.pos = NULL;
+	src.fp = NULL;
+	src.str = NULL;
+	src.mapped = 0;
+	cache.path = NULL;
+	bc.data = NULL;
+	bc.ops = NULL;
+	stats.steps = -1;
+	stats.lo = 0;
+	stats.hi = 0;
+	stats.counts = NULL;
+	ck.child = 0;
+	if (io_init(&io, buffered && !emit, eof) != INT_SUCC || !tape.cells)
 		ERROR("bad memory allocation");
+	io.timed = want_stats;
 
-	ptr->c = 0;
-	ptr->prev = NULL;
-	ptr->next = NULL;
+	/* the manifest's results are all the output there is */
+	if (batch) {
+		status = batch_run(fp, bits ? bits : 8,
+				   engine == 'j' ? BF_JIT : engine == 's'
+					? BF_SWITCH : BF_THREADED,
+				   eof, max_steps, timeout, (size_t) max_tape,
+				   threads, &failed);
+		if (status == INT_INVL)
+			ERROR("too many fields in the manifest");
+		else if (status == INT_MEMERR)
+			ERROR("bad memory allocation");
+		else if (status == INT_IOERR)
+			ERROR("input/output error");
+		if (failed)
+			ret = EXIT_FAILURE;
+		goto cleanup;
+	}
 
-	if (fseek(fp, 0L, SEEK_END))
-		ERROR("cannot read file");
+	start = io_time();
 
-	fsize = ftell(fp);
-	if (fsize == -1)
-		ERROR("cannot read file");
+	if (from_bytecode) {
+		status = bytecode_open(&bc, &prog, fp, &n);
+		if (status == INT_INVL)
+			ERROR("not a valid bytecode file");
+		else if (status == INT_MEMERR)
+			ERROR("bad memory allocation");
+		else if (status == INT_IOERR)
+			ERROR("cannot read file");
+		if (bits && bits != n)
+			ERROR("bytecode is for a different cell width");
+		if (profile)
+			ERROR("bytecode has no source offsets to profile");
+		bits = n;
+		stats.compile = io_time() - start;
+		start = io_time();
+	} else {
+		if (!bits)
+			bits = 8;
+		if (source_open(&src, fp) != INT_SUCC)
+			ERROR("bad memory allocation");
 
-	if (fseek(fp, 0L, SEEK_SET))
-		ERROR("cannot read file");
+		/*
+		 * Running the start of the program ahead of time would
+		 * let it off the steps or seconds that takes, and with
+		 * checkpoints a resumed run has to have the same program
+		 * whether it's limited or not. Profiling wants to see the
+		 * whole program run.
+		 */
+		ahead = !profile && max_steps < 0 && !timeout && !every &&
+			!resume;
 
-	if ((unsigned long) fsize > SIZE_MAX)
-		ERROR("file too large");
+		/* the profiler needs source offsets, which aren't cached */
+		if (use_cache && !profile) {
+			status = cache_open(&cache, &src, bits, ahead);
+			if (status == INT_MEMERR)
+				ERROR("bad memory allocation");
+			else if (status == INT_IOERR)
+				ERROR("cannot read file");
+			cached = cache_load(&cache, &prog);
+		}
 
-	str = (char *) malloc(fsize);
-	if (!str)
-		ERROR("bad memory allocation");
+		status = cached ? INT_SUCC
+				: compile(&prog, &src, profile && !emit);
+
+		if (status == INT_INVL)
+			ERROR("unmatched brackets");
+		else if (status == INT_MEMERR)
+			ERROR("bad memory allocation");
+		else if (status == INT_IOERR)
+			ERROR("cannot read file");
+
+		/* the source isn't needed anymore once it's compiled */
+		source_close(&src);
+
+		stats.compile = io_time() - start;
+		start = io_time();
+
+		if (!cached) {
+			optimize(&prog);
+			fuse(&prog);
 
-	if (fread(str, 1, fsize, fp) != (size_t) fsize)
-		ERROR("cannot read file");
+			if (ahead && precompute(&prog, bits) != INT_SUCC)
+				ERROR("bad memory allocation");
 
-	status = interpret(ptr, str, fsize);
+			cache_save(&cache, &prog);
+		}
+	}
+
+	tape.width = bits / 8;
+	stats.optimize = io_time() - start;
+
+	if (emit) {
+		if (emit == 's' && bits != 8)
+			ERROR("assembly output only supports 8-bit cells");
+		status = emit == 'c' ? emit_c(stdout, &prog, eof, bits)
+		       : emit == 'b' ? bytecode_write(stdout, &prog, bits)
+				     : emit_asm(stdout, &prog, eof);
+		if (status == INT_INVL)
+			ERROR("assembly output is not supported here");
+		else if (status == INT_IOERR || fflush(stdout))
+			ERROR("input/output error");
+		goto cleanup;
+	}
+
+	if (profile) {
+		stats.counts = (double *) calloc(prog.len, sizeof(double));
+		if (!stats.counts)
+			ERROR("bad memory allocation");
+	}
+
+	/*
+	 * If the JIT isn't available here, the interpreter will do,
+	 * and without computed goto the threaded interpreter is the
+	 * switch one. Profiling always uses its own interpreter, and
+	 * the JIT only knows about 8-bit cells.
+	 *
+	 * The JIT only gets the program once it's run for long enough
+	 * on the threaded interpreter, see jit_hot(), unless the stats
+	 * are wanted, which would only cover the start of the run.
+	 */
+	if (engine != 'j' || profile || bits != 8)
+		hot = -1;
+	else if (want_stats)
+		hot = 0;
+	else if (hot < 0)
+		hot = jit_hot(&prog);
+	if (!hot) {
+		jit = jit_compile(&prog);
+		hot = -1;
+	}
 
-	if (status == INT_INVL)
-		ERROR("unmatched brackets");
-	else if (status == INT_MEMERR)
+	/*
+	 * Only the plain interpreters skip their checks on a guarded
+	 * tape, but the rest don't mind running on one. Without
+	 * support for it, it's the usual tape.
+	 */
+	if (guard)
+		guard = tape_guard(&tape, &prog);
+
+	/*
+	 * A resumed run reads and writes again whatever it did after
+	 * the checkpoint, so the input it had already read is skipped
+	 * and the output it had written is cut off, see checkpoint.c.
+	 */
+	checkpoint_init(&ck, ck_path, &prog, bits);
+	if (resume) {
+		ck_fp = fopen(resume, "rb");
+		if (!ck_fp)
+			ERROR("could not open the checkpoint");
+		status = checkpoint_load(&ck, ck_fp, &prog, &tape);
+		fclose(ck_fp);
+		if (status == INT_INVL)
+			ERROR("not a checkpoint of this program");
+		else if (status == INT_MEMERR)
+			ERROR(tape.full ? "checkpoint has more tape than "
+					  "--max-tape allows"
+					: "bad memory allocation");
+		else if (status == INT_IOERR)
+			ERROR("cannot read the checkpoint");
+		if (io_skip(&io, ck.in))
+			ERROR("input ran out before where the checkpoint was");
+		io.nout = ck.out;
+		checkpoint_output(&ck);
+	}
+
+	start = io_time();
+	limit_init(&limit, max_steps, timeout, every, hot);
+	limit.pc = ck.pc;
+
+	engines = engines_for(bits);
+	threaded = engine != 's';
+
+	/* checkpoints and the move to the JIT stop the run, which carries on */
+	for (;;) {
+		if (profile)
+			status = engines->profile(&tape, &prog, &io, &limit,
+						  &stats);
+		else if (jit)
+			status = jit_run(jit, &tape, &io, &limit);
+		else if (want_stats)
+			status = engines->stats[threaded](&tape, &prog, &io,
+							  &limit, &stats);
+		else if (guard)
+			status = tape_run(&tape, engines->guarded[threaded],
+					  &prog, &io, &limit);
+		else
+			status = engines->plain[threaded](&tape, &prog, &io,
+							  &limit, NULL);
+
+		if (status != INT_LIMIT ||
+		    (limit.hit != 'c' && limit.hit != 'j'))
+			break;
+
+		tape.origin = limit.ptr - tape.cells;
+		if (limit.hit == 'j') {
+			/* if it can't be compiled after all, it stays put */
+			jit = jit_compile(&prog);
+		} else {
+			if (io_flush(&io)) {
+				status = INT_IOERR;
+				break;
+			}
+			if (checkpoint_save(&ck, &tape, &io, limit.pc) !=
+			    INT_SUCC)
+				ERROR("could not write the checkpoint");
+		}
+		limit.hit = 0;
+	}
+
+	if (io_flush(&io) && status == INT_SUCC)
+		status = INT_IOERR;
+
+	/* growing past --max-tape is running off the end, not out of memory */
+	if (status == INT_MEMERR && tape.full)
+		status = INT_BOUNDS;
+
+	stats.run = io_time() - start;
+
+	/* the reports go to stderr so they stay out of the output */
+	if (want_stats)
+		stats_report(stderr, &stats, &tape, &io);
+	if (profile &&
+	    profile_report(stderr, &prog, stats.counts) != INT_SUCC)
+		ERROR("bad memory allocation");
+
+	if (status == INT_MEMERR)
 		ERROR("bad memory allocation");
 	else if (status == INT_IOERR)
 		ERROR("input/output error");
+	else if (status == INT_BOUNDS)
+		ERROR("pointer ran off the tape");
+	else if (status == INT_LIMIT)
+		FAIL(limit.hit == 't' ? "ran out of time" : "ran out of steps",
+		     EXIT_LIMIT);
 
-cleanup:
-	/* move to beginning of list to prepare for cleanup */
-	while (ptr->prev)
-		ptr = ptr->prev;
-
-	while (ptr) {
-		tmp = ptr->next;
-		free(ptr);
-		ptr = tmp;
-	}
+	if (checkpoint_wait(&ck) != INT_SUCC)
+		ERROR("could not write the checkpoint");
 
-	free(str);
-	fclose(fp);
+cleanup:
+	checkpoint_wait(&ck);
+	if (jit)
+		jit_free(jit);
+	io_free(&io);
+	tape_free(&tape);
+	if (from_bytecode)
+		bytecode_close(&bc, &prog);
+	free(prog.ops);
+	free(prog.pos);
+	free(stats.counts);
+	source_close(&src);
+	cache_close(&cache);
+	if (fp != stdin)
+		fclose(fp);
 
 	return ret;
 }
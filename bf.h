@@ -0,0 +1,152 @@
+/*
+ * libbf: the engines behind bf as a library, for running lots of
+ * brainfuck programs in one process instead of one process each.
+ *
+ * A program is compiled and optimized once by bf_compile() and can
+ * then be run any number of times. Running it doesn't change it,
+ * so one program can be run in several contexts at once, from
+ * different threads. A context is everything a run does change:
+ * the tape, and where input comes from and output goes. Nothing
+ * is kept anywhere else, so each thread can have its own context,
+ * but a context can only be used by one thread at a time.
+ *
+ * By default a context reads no input at all and keeps its output
+ * in memory, for bf_ctx_output(). bf_ctx_input() gives it input
+ * from memory instead, and bf_ctx_io() hands both over to
+ * callbacks. bf_ctx_limits() stops programs that run too long.
+ *
+ * The tape is infinite in both directions, as it is for bf, unless
+ * it's limited, and output is buffered until the program reads
+ * input or ends.
+ */
+
+#ifndef BF_H
+#define BF_H
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* what bf_compile() and bf_run() return */
+enum {
+	BF_OK,		/* success */
+	BF_INVALID,	/* unmatched brackets, or a bad argument */
+	BF_NOMEM,	/* bad memory allocation */
+	BF_IOERR,	/* a callback gave an error */
+	BF_STEPS,	/* the program ran out of steps */
+	BF_TIMEOUT,	/* the program ran out of time */
+	BF_TAPE		/* the program ran off the end of the tape */
+};
+
+/* engines for bf_compile(), the same as bf's --engine */
+enum {
+	BF_THREADED,	/* the fastest interpreter that's been built */
+	BF_SWITCH,	/* the portable interpreter */
+	BF_JIT		/* native code, or BF_THREADED if it can't be */
+};
+
+#define BF_EOF_KEEP (-2)	/* at the end of input, leave the cell */
+
+struct bf_program;
+struct bf_ctx;
+
+/*
+ * Callbacks for input and output, which get the user pointer
+ * given to bf_ctx_io() along with the bytes. A read callback
+ * returns how many bytes it put in buf, up to len, 0 at the end
+ * of input or less than 0 for an error, which also counts as the
+ * end of input. A write callback returns nonzero for an error,
+ * which stops the program with BF_IOERR.
+ */
+typedef long (*bf_read_fn)(void *user, unsigned char *buf, size_t len);
+typedef int (*bf_write_fn)(void *user, const unsigned char *buf,
+			   size_t len);
+
+/*
+ * Compiles and optimizes a program.
+ *
+ * args: source, its size, bits in a cell (8, 16 or 32), engine
+ *       to run it on, where to put the status if not NULL
+ * returns: the program, or NULL if the status isn't BF_OK
+ */
+struct bf_program *bf_compile(const char *src, size_t len, int bits,
+			      int engine, int *status);
+
+void bf_free(struct bf_program *prog);
+
+/*
+ * Makes a context with an empty tape.
+ *
+ * args: what , stores at the end of input: 0, -1 (which is all
+ *       ones) or BF_EOF_KEEP
+ * returns: the context, or NULL for bad memory allocation
+ */
+struct bf_ctx *bf_ctx_new(int eof);
+
+/*
+ * Clears a context's tape and output and goes back to the start
+ * of the input from bf_ctx_input(), so that it's as good as new.
+ * Where input and output go is kept.
+ */
+void bf_ctx_reset(struct bf_ctx *ctx);
+
+void bf_ctx_free(struct bf_ctx *ctx);
+
+/*
+ * Sends a context's input and output through callbacks. Either may
+ * be NULL, for the input from bf_ctx_input(), if there is any, or
+ * to keep the output.
+ */
+void bf_ctx_io(struct bf_ctx *ctx, bf_read_fn read, bf_write_fn write,
+	       void *user);
+
+/*
+ * Makes a context read its input from memory rather than a
+ * callback. The input isn't copied, so it has to stay there for
+ * as long as the context might read it.
+ */
+void bf_ctx_input(struct bf_ctx *ctx, const void *buf, size_t len);
+
+/*
+ * Limits how long each run in a context can go on for and how
+ * long its tape can get, the same as bf's --max-steps, --timeout
+ * and --max-tape. A step is an instruction of a loop going round
+ * once, after optimizing, and the time is only checked every
+ * million or so steps, so neither is exact. A program that's
+ * stopped can't be carried on with.
+ *
+ * args: context, most steps a run can take or -1 for no limit,
+ *       most seconds it can run for or 0 for no limit, most bytes
+ *       of tape or 0 for no limit
+ */
+void bf_ctx_limits(struct bf_ctx *ctx, double steps, double seconds,
+		   size_t tape);
+
+/*
+ * Gets the output a context has kept since it was made or reset.
+ * It's only good until the context is next run, reset or freed.
+ *
+ * args: context, where to put the size of the output
+ * returns: the output
+ */
+const unsigned char *bf_ctx_output(const struct bf_ctx *ctx, size_t *len);
+
+/*
+ * Runs a program in a context. The tape is left as the program left
+ * it, so another run carries on with those cells, starting on the
+ * cell the first one started on, unless it's reset first. A
+ * program with cells of a different width always starts on an
+ * empty tape.
+ *
+ * returns: BF_OK, BF_NOMEM, BF_IOERR, BF_STEPS, BF_TIMEOUT or
+ *          BF_TAPE
+ */
+int bf_run(struct bf_ctx *ctx, const struct bf_program *prog);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
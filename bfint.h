@@ -0,0 +1,360 @@
+/*
+ * Declarations shared between the parts of bf: the tape, the
+ * compiled program and the engines that run it.
+ */
+
+#ifndef BFINT_H
+#define BFINT_H
+
+#include <stddef.h>
+#include <stdio.h>
+
+/*
+ * This would be in stdint.h, but that was introduced in C99,
+ * so we're going to define it outselves just to be safe.
+ */
+#ifdef SIZE_MAX
+#undef SIZE_MAX
+#endif
+
+#define SIZE_MAX ((size_t) -1)
+
+#define TAPE_INIT 4096
+
+/* the limit on a tape never goes under this, so it can get started */
+#define TAPE_LEAST (4 * TAPE_INIT)
+
+/*
+ * cells holds len bytes of cells, width bytes each, all of
+ * which have been initialized. origin is where in those bytes
+ * the cell the program started on is, which moves whenever the
+ * tape grows to the left. base is NULL unless
+ * the tape is guarded, see tape.c, in which case cells lies in
+ * the size bytes reserved at base, with guard bytes at each end
+ * that are never mapped. Otherwise mapped is set if cells came
+ * from mmap() rather than malloc(). max is the most bytes len can
+ * grow to, or 0 for no limit, and full is set once it's tried to
+ * grow past that.
+ */
+struct tape {
+	unsigned char *cells;
+	size_t len;
+	size_t origin;
+	size_t width;
+	unsigned char *base;
+	size_t size;
+	size_t guard;
+	size_t page;
+	int mapped;
+	size_t max;
+	int full;
+};
+
+/*
+ * The instructions the interpreter actually runs. Runs of + and -
+ * and of < and > are folded into a single ADD or MOVE, and every
+ * bracket knows the index of its match. The rest are produced by
+ * optimize() out of common loops. Cell off is off cells from the
+ * pointer, which fuse() uses to do away with most moves.
+ */
+enum {
+	OP_ADD,		/* add arg to cell off */
+	OP_MOVE,	/* move the pointer arg cells to the right */
+	OP_OUT,		/* write cell off */
+	OP_IN,		/* read into cell off */
+	OP_JZ,		/* jump past op arg if the current cell is zero */
+	OP_JNZ,		/* jump past op arg if the current cell isn't */
+	OP_SET,		/* set cell off to arg */
+	OP_MUL,		/* add the current cell times arg to cell off */
+	OP_SCAN,	/* move by arg cells until the current cell is zero */
+	OP_END		/* stop */
+};
+
+struct op {
+	int kind;
+	int off;
+	long arg;
+};
+
+/*
+ * A compiled program, always terminated by an OP_END. No
+ * instruction reaches further than margin cells away from
+ * the pointer. pos is NULL unless the program is going to be
+ * profiled, in which case it holds the source offset of each
+ * instruction.
+ */
+struct program {
+	struct op *ops;
+	size_t *pos;
+	size_t len;
+	size_t cap;
+	size_t margin;
+};
+
+typedef enum {
+	INT_SUCC, INT_INVL, INT_MEMERR, INT_IOERR, INT_BOUNDS, INT_LIMIT
+} INT_STAT;
+
+/*
+ * The limits on a run, see limit.c. steps is how many more steps
+ * can be handed out to the engine, or -1 for no limit, deadline is
+ * the io_time() to stop at, or 0 for none, and hit is 's' or 't'
+ * once the steps or the time have run out. every is the seconds
+ * between checkpoints, or 0 for none, and due is the io_time()
+ * the next one is due at, which stops the run with hit set to 'c'.
+ * hot is how many more steps to run before moving to the JIT, or
+ * -1 for never, and that stops it with hit set to 'j'. pc is the
+ * instruction an engine starts from, and when it stops for either
+ * of those, pc and ptr are where to carry on from and carry is
+ * the budget it had left, which is 0 or less.
+ */
+struct limit {
+	double steps;
+	double deadline;
+	int hit;
+	double every;
+	double due;
+	double hot;
+	long carry;
+	size_t pc;
+	unsigned char *ptr;
+};
+
+/*
+ * What the interpreters count for --stats and --profile. steps is
+ * how many instructions ran, or -1 if the engine doesn't count,
+ * and lo and hi are the furthest the pointer got to either side
+ * of where it started. counts has room for a count per
+ * instruction, but only when profiling. main() fills in the rest.
+ */
+struct stats {
+	double steps;
+	long lo;
+	long hi;
+	double *counts;
+	double compile;		/* seconds spent reading and compiling */
+	double optimize;	/* seconds spent in optimize() */
+	double run;		/* seconds spent running */
+};
+
+#define IO_BUFSIZE 65536
+
+/*
+ * Buffered input and output, see io.c. outcap is 0 when output
+ * is unbuffered, which sends every byte down the slow path. in
+ * holds inlen bytes read ahead, of which inpos have been used.
+ * eof is what IO_GET() gives at the end of input: 0, -1 (which
+ * is 255 once it's stored in a cell) or IO_KEEP. nin and nout
+ * count bytes read and written, and if timed is set, time adds
+ * up the seconds spent actually reading and writing.
+ *
+ * The bytes come from read and go to write, which io_init() sets
+ * to stdin and stdout and the library sets to whatever it's told
+ * to, with user passed along to both. read gives the number of
+ * bytes it read, 0 at the end of input or less for an error, and
+ * write gives nonzero for an error.
+ */
+struct io {
+	long (*read)(void *user, unsigned char *buf, size_t len);
+	int (*write)(void *user, const unsigned char *buf, size_t len);
+	void *user;
+	unsigned char *out;
+	size_t outlen;
+	size_t outcap;
+	unsigned char *in;
+	size_t inpos;
+	size_t inlen;
+	int eof;
+	double nin;
+	double nout;
+	double time;
+	int timed;
+};
+
+/* an interpreter, see interp.h */
+typedef INT_STAT (*interp_fn)(struct tape *tape, const struct program *prog,
+			      struct io *io, struct limit *limit,
+			      struct stats *stats);
+
+/*
+ * The interpreters for one cell width, see engines.c. Each kind
+ * has one for the switch and one for the threaded engine, in that
+ * order.
+ */
+struct engines {
+	interp_fn plain[2];
+	interp_fn stats[2];
+	interp_fn guarded[2];
+	interp_fn profile;
+};
+
+#define IO_KEEP (-2)	/* end of input, leave the cell alone */
+#define IO_ERR (-3)	/* I/O error */
+
+/* writes a byte; evaluates to nonzero for I/O error */
+#define IO_PUT(io, c) \
+	((io)->outlen < (io)->outcap \
+		? ((io)->out[(io)->outlen++] = (unsigned char) (c), 0) \
+		: io_put((io), (c)))
+
+/* reads a byte; evaluates to the byte, io->eof or IO_ERR */
+#define IO_GET(io) \
+	((io)->inpos < (io)->inlen ? (io)->in[(io)->inpos++] : io_get((io)))
+
+#define SOURCE_WINDOW (16UL << 20)	/* most of a file mapped at once */
+
+/*
+ * A source file being read a piece at a time, see io.c, or a
+ * string that's all one piece, in which case fp is NULL.
+ */
+struct source {
+	FILE *fp;
+	char *str;	/* the current piece */
+	size_t len;
+	size_t pos;	/* where the piece starts, if mapped or a string */
+	size_t size;	/* size of a mapped file or string */
+	int mapped;	/* pieces are mapped, not read into str */
+};
+
+/*
+ * Where the compiled program for a source is cached, see cache.c.
+ * path is NULL if it isn't, size is the length of the source and
+ * digest is its SHA-256, in hex.
+ */
+struct cache {
+	char *path;
+	size_t size;
+	int bits;
+	char digest[65];
+};
+
+/* compile.c */
+INT_STAT compile(struct program *prog, struct source *src, int positions);
+void optimize(struct program *prog);
+void fuse(struct program *prog);
+INT_STAT precompute(struct program *prog, int bits);
+
+/* engines.c */
+const struct engines *engines_for(int bits);
+
+/* tape.c */
+unsigned char *tape_grow(struct tape *tape, unsigned char *ptr, long n);
+unsigned char *tape_reserve(struct tape *tape, unsigned char *ptr,
+			    long margin);
+int tape_guard(struct tape *tape, const struct program *prog);
+INT_STAT tape_run(struct tape *tape, interp_fn interp,
+		  const struct program *prog, struct io *io,
+		  struct limit *limit);
+void tape_clear(struct tape *tape);
+void tape_free(struct tape *tape);
+
+/* limit.c */
+void limit_init(struct limit *limit, double steps, double seconds,
+		double every, double hot);
+long limit_start(struct limit *limit);
+long limit_more(struct limit *limit, long left, size_t pc,
+		unsigned char *ptr);
+
+/* scan.c */
+#define SCAN_MAX 16	/* longest step in bytes that scanning speeds up */
+size_t scan_right(const unsigned char *p, size_t len, size_t step,
+		  size_t width);
+size_t scan_left(const unsigned char *p, size_t len, size_t step,
+		 size_t width);
+
+/* io.c */
+INT_STAT io_init(struct io *io, int buffered, int eof);
+void io_free(struct io *io);
+int io_flush(struct io *io);
+int io_put(struct io *io, int c);
+int io_get(struct io *io);
+int io_buffered(void);
+double io_read(const struct io *io);
+int io_skip(struct io *io, double n);
+double io_time(void);
+INT_STAT source_open(struct source *src, FILE *fp);
+void source_string(struct source *src, const char *str, size_t len);
+INT_STAT source_next(struct source *src);
+void source_close(struct source *src);
+
+/*
+ * A bytecode file that's been loaded, see bytecode.c. data holds
+ * the size bytes of the file, and ops holds the instructions if
+ * they had to be converted.
+ */
+struct bytecode {
+	unsigned char *data;
+	size_t size;
+	struct op *ops;
+};
+
+/*
+ * A run that's being checkpointed or resumed, see checkpoint.c.
+ * bits and sum say which program it is, pc is the instruction to
+ * carry on from, and in and out are the bytes of input read and
+ * of output written before it. If stdout was a regular file, dev
+ * and ino say which one and at is how far into it the output had
+ * got, and otherwise at is -1. path is where checkpoints go, and
+ * child is the process still writing the last one, or 0.
+ */
+struct checkpoint {
+	const char *path;
+	int bits;
+	unsigned long sum[2];
+	size_t pc;
+	double in;
+	double out;
+	unsigned long dev;
+	unsigned long ino;
+	double at;
+	long child;
+};
+
+/* batch.c */
+#define BATCH_THREADS_MAX 256	/* most threads --threads can ask for */
+INT_STAT batch_run(FILE *fp, int bits, int engine, int eof, double steps,
+		   double seconds, size_t tape, int threads, size_t *failed);
+
+/* bytecode.c */
+int bytecode_valid(const struct program *prog);
+void bytecode_sum(const struct program *prog, unsigned long *sum);
+INT_STAT bytecode_write(FILE *fp, const struct program *prog, int bits);
+INT_STAT bytecode_open(struct bytecode *bc, struct program *prog, FILE *fp,
+		       int *bits);
+void bytecode_close(struct bytecode *bc, struct program *prog);
+
+/* cache.c */
+INT_STAT cache_open(struct cache *cache, struct source *src, int bits,
+		    int ahead);
+int cache_load(const struct cache *cache, struct program *prog);
+void cache_save(const struct cache *cache, const struct program *prog);
+void cache_close(struct cache *cache);
+
+/* checkpoint.c */
+void checkpoint_init(struct checkpoint *ck, const char *path,
+		     const struct program *prog, int bits);
+INT_STAT checkpoint_save(struct checkpoint *ck, const struct tape *tape,
+			 const struct io *io, size_t pc);
+INT_STAT checkpoint_wait(struct checkpoint *ck);
+INT_STAT checkpoint_load(struct checkpoint *ck, FILE *fp,
+			 const struct program *prog, struct tape *tape);
+void checkpoint_output(const struct checkpoint *ck);
+
+/* emit.c */
+INT_STAT emit_c(FILE *fp, const struct program *prog, int eof, int bits);
+INT_STAT emit_asm(FILE *fp, const struct program *prog, int eof);
+
+/* profile.c */
+INT_STAT profile_report(FILE *fp, const struct program *prog,
+			const double *counts);
+void stats_report(FILE *fp, const struct stats *stats,
+		  const struct tape *tape, const struct io *io);
+
+/* jit.c */
+double jit_hot(const struct program *prog);
+struct jit *jit_compile(const struct program *prog);
+INT_STAT jit_run(struct jit *jit, struct tape *tape, struct io *io,
+		 struct limit *limit);
+void jit_free(struct jit *jit);
+
+#endif
@@ -0,0 +1,364 @@
+/*
+ * Compiled programs as files, for --compile and --run-bytecode.
+ *
+ * A bytecode file is a 32-byte header and then a 16-byte record
+ * for each instruction, with every number little-endian:
+ *
+ *   0	"bfbc"
+ *   4	BYTECODE_VERSION
+ *   8	bits in a cell, 8, 16 or 32
+ *   12	margin, see struct program
+ *   16	number of instructions, 64 bits
+ *   24	checksum of the records, see checksum()
+ *
+ * and each record is the kind (32 bits), the offset (32 bits,
+ * signed) and the argument (64 bits, signed) of an instruction.
+ *
+ * The records are laid out the same as struct op is on 64-bit
+ * little-endian machines, so there the engines run the
+ * instructions straight out of the bytes that were read, without
+ * converting anything. Anywhere else they're converted as they're
+ * read. Either way the file is checked before anything runs it,
+ * since it may come from somewhere else. It's read into memory
+ * of bf's own rather than mapped, since whatever else can write
+ * to the file could change a mapping after it had been checked,
+ * or cut it short and have the run die of SIGBUS.
+ */
+
+#if defined(__unix__) || defined(__APPLE__)
+#define BYTECODE_STAT
+#define _POSIX_C_SOURCE 200809L
+#endif
+
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef BYTECODE_STAT
+#include <sys/stat.h>
+#endif
+
+#include "bfint.h"
+
+#define BYTECODE_VERSION 1
+#define HEAD_SIZE 32
+#define RECORD_SIZE 16
+#define MOVE_MAX (LONG_MAX / 4)	/* furthest a move goes, in the widest cells */
+
+static void put_le(unsigned char *p, unsigned long v, int n)
+{
+	while (n--) {
+		*p++ = (unsigned char) (v & 0xff);
+		v >>= 8;
+	}
+}
+
+static unsigned long get_le(const unsigned char *p, int n)
+{
+	unsigned long v = 0;
+
+	while (n--)
+		v = v << 8 | p[n];
+
+	return v;
+}
+
+/* the 64 bits of a record's argument, sign-extended if long is short */
+static void put_arg(unsigned char *p, long arg)
+{
+	int i, n = sizeof(long) < 8 ? (int) sizeof(long) : 8;
+
+	put_le(p, (unsigned long) arg, n);
+	for (i = n; i < 8; ++i)
+		p[i] = arg < 0 ? 0xff : 0;
+}
+
+/* returns: nonzero if the argument fits in a long */
+static int get_arg(const unsigned char *p, long *arg)
+{
+	int i, n = sizeof(long) < 8 ? (int) sizeof(long) : 8;
+	unsigned long u = get_le(p, n);
+	int neg = p[n - 1] >> 7;
+
+	for (i = n; i < 8; ++i)
+		if (p[i] != (neg ? 0xff : 0))
+			return 0;
+
+	*arg = u > LONG_MAX ? -(long) ~u - 1 : (long) u;
+
+	return 1;
+}
+
+static void put_record(unsigned char *p, const struct op *op)
+{
+	put_le(p, (unsigned long) op->kind, 4);
+	put_le(p + 4, (unsigned long) op->off, 4);
+	put_arg(p + 8, op->arg);
+}
+
+/*
+ * Adds some records to a Fletcher checksum of them, taken 32 bits
+ * at a time: the sum of the words and the sum of those sums, both
+ * modulo 2^32 once they're masked. That's a couple of adds a
+ * word, where a hash that went a byte at a time would cost a lot
+ * more than reading the file does.
+ *
+ * args: records, bytes of them, the two sums so far
+ */
+static void checksum(const unsigned char *p, size_t len, unsigned long *sum)
+{
+	unsigned long a = sum[0], b = sum[1];
+
+	for (; len >= 4; len -= 4, p += 4) {
+		a += get_le(p, 4);
+		b += a;
+	}
+
+	sum[0] = a;
+	sum[1] = b;
+}
+
+/*
+ * Works out whether struct op is laid out the same as a record
+ * here, by making one of each with every field different and
+ * comparing them.
+ */
+static int native(void)
+{
+	unsigned char rec[RECORD_SIZE];
+	struct op op;
+
+	if (sizeof(struct op) != RECORD_SIZE)
+		return 0;
+
+	memset(&op, 0, sizeof(op));
+	op.kind = OP_SCAN;
+	op.off = -2;
+	op.arg = -3;
+	put_record(rec, &op);
+
+	return !memcmp(rec, &op, RECORD_SIZE);
+}
+
+/*
+ * Checks that a program from a file the engines have to run makes
+ * sense: every bracket matches, nothing reaches past the margin,
+ * every move and scan goes somewhere the engines can work out
+ * without overflowing and it ends with OP_END, after which they
+ * can't go wrong.
+ *
+ * returns: nonzero if the program is fine
+ */
+int bytecode_valid(const struct program *prog)
+{
+	const struct op *ops = prog->ops;
+	size_t i, j;
+
+	if (!prog->len || ops[prog->len - 1].kind != OP_END)
+		return 0;
+
+	for (i = 0; i < prog->len; ++i) {
+		if (ops[i].kind < OP_ADD || ops[i].kind > OP_END ||
+		    (ops[i].kind == OP_END && i != prog->len - 1) ||
+		    ops[i].off < -INT_MAX ||
+		    (size_t) abs(ops[i].off) > prog->margin)
+			return 0;
+		if ((ops[i].kind == OP_MOVE || ops[i].kind == OP_SCAN) &&
+		    (ops[i].arg < -MOVE_MAX || ops[i].arg > MOVE_MAX ||
+		     (ops[i].kind == OP_SCAN && !ops[i].arg)))
+			return 0;
+		if (ops[i].kind != OP_JZ && ops[i].kind != OP_JNZ)
+			continue;
+
+		j = (size_t) ops[i].arg;
+		if (ops[i].arg < 0 || j >= prog->len ||
+		    (size_t) ops[j].arg != i ||
+		    (ops[i].kind == OP_JZ) != (j > i) ||
+		    ops[j].kind != (ops[i].kind == OP_JZ ? OP_JNZ : OP_JZ))
+			return 0;
+	}
+
+	return 1;
+}
+
+/*
+ * The checksum of a program's records, which is also what tells a
+ * checkpoint which program it's for.
+ *
+ * args: program, where to put the two sums
+ */
+void bytecode_sum(const struct program *prog, unsigned long *sum)
+{
+	unsigned char rec[RECORD_SIZE];
+	size_t i;
+
+	sum[0] = sum[1] = 0;
+	for (i = 0; i < prog->len; ++i) {
+		put_record(rec, &prog->ops[i]);
+		checksum(rec, RECORD_SIZE, sum);
+	}
+	sum[0] &= 0xffffffffUL;
+	sum[1] &= 0xffffffffUL;
+}
+
+/*
+ * Writes a program out as bytecode.
+ *
+ * args: file to write to, program from optimize(), bits in a cell
+ * returns: 0 for success, 3 for I/O error
+ */
+INT_STAT bytecode_write(FILE *fp, const struct program *prog, int bits)
+{
+	unsigned char head[HEAD_SIZE], rec[RECORD_SIZE];
+	unsigned long sum[2];
+	size_t i;
+
+	/* the checksum goes in the header, so it comes first */
+	bytecode_sum(prog, sum);
+
+	memset(head, 0, HEAD_SIZE);
+	memcpy(head, "bfbc", 4);
+	put_le(head + 4, BYTECODE_VERSION, 4);
+	put_le(head + 8, (unsigned long) bits, 4);
+	put_le(head + 12, (unsigned long) prog->margin, 4);
+	put_le(head + 16, (unsigned long) prog->len & 0xffffffffUL, 4);
+	put_le(head + 20, (unsigned long) (prog->len >> 16 >> 16), 4);
+	put_le(head + 24, sum[0], 4);
+	put_le(head + 28, sum[1], 4);
+	if (fwrite(head, 1, HEAD_SIZE, fp) != HEAD_SIZE)
+		return INT_IOERR;
+
+	for (i = 0; i < prog->len; ++i) {
+		put_record(rec, &prog->ops[i]);
+		if (fwrite(rec, 1, RECORD_SIZE, fp) != RECORD_SIZE)
+			return INT_IOERR;
+	}
+
+	return INT_SUCC;
+}
+
+/*
+ * Reads a whole file into memory, in one go if it knows how big
+ * the file is.
+ */
+static INT_STAT read_all(struct bytecode *bc, FILE *fp)
+{
+	unsigned char *data;
+	size_t cap = IO_BUFSIZE, n;
+#ifdef BYTECODE_STAT
+	struct stat st;
+
+	/* one more byte, so the first read can tell it got to the end */
+	if (!fstat(fileno(fp), &st) && S_ISREG(st.st_mode) &&
+	    (unsigned long) st.st_size < SIZE_MAX)
+		cap = (size_t) st.st_size + 1;
+#endif
+
+	bc->data = (unsigned char *) malloc(cap);
+	if (!bc->data)
+		return INT_MEMERR;
+
+	while ((n = fread(bc->data + bc->size, 1, cap - bc->size, fp))) {
+		bc->size += n;
+		if (bc->size < cap)
+			continue;
+		if (cap > SIZE_MAX / 2)
+			return INT_MEMERR;
+		cap *= 2;
+		data = (unsigned char *) realloc(bc->data, cap);
+		if (!data)
+			return INT_MEMERR;
+		bc->data = data;
+	}
+
+	return ferror(fp) ? INT_IOERR : INT_SUCC;
+}
+
+/*
+ * Loads a bytecode file. The program may point into what was
+ * read of the file, so it has to be let go of with
+ * bytecode_close() and not freed.
+ *
+ * args: bytecode state to set up, program to fill, open file,
+ *       where to put the bits in a cell
+ * returns: 0 for success, 1 for a file that isn't valid bytecode,
+ *          2 for bad memory allocation, 3 for I/O error
+ */
+INT_STAT bytecode_open(struct bytecode *bc, struct program *prog, FILE *fp,
+		       int *bits)
+{
+	unsigned long n, hi, sum[2] = { 0, 0 };
+	const unsigned char *rec;
+	INT_STAT status;
+	size_t len, i;
+
+	bc->data = NULL;
+	bc->size = 0;
+	bc->ops = NULL;
+	prog->ops = NULL;
+	prog->pos = NULL;
+
+	status = read_all(bc, fp);
+	if (status != INT_SUCC)
+		return status;
+
+	if (bc->size < HEAD_SIZE || memcmp(bc->data, "bfbc", 4) ||
+	    get_le(bc->data + 4, 4) != BYTECODE_VERSION)
+		return INT_INVL;
+
+	n = get_le(bc->data + 8, 4);
+	/* the count is 64 bits, which size_t may not be able to hold */
+	hi = get_le(bc->data + 20, 4);
+	len = (size_t) hi << 16 << 16;
+	if (len >> 16 >> 16 != hi)
+		return INT_INVL;
+	len |= get_le(bc->data + 16, 4);
+	if ((n != 8 && n != 16 && n != 32) || !len ||
+	    len > (bc->size - HEAD_SIZE) / RECORD_SIZE ||
+	    bc->size != HEAD_SIZE + len * RECORD_SIZE)
+		return INT_INVL;
+
+	checksum(bc->data + HEAD_SIZE, len * RECORD_SIZE, sum);
+	if ((sum[0] & 0xffffffffUL) != get_le(bc->data + 24, 4) ||
+	    (sum[1] & 0xffffffffUL) != get_le(bc->data + 28, 4))
+		return INT_INVL;
+
+	*bits = (int) n;
+	prog->len = prog->cap = len;
+	prog->margin = get_le(bc->data + 12, 4);
+
+	if (native()) {
+		prog->ops = (struct op *) (bc->data + HEAD_SIZE);
+	} else {
+		if (len > SIZE_MAX / sizeof(struct op))
+			return INT_MEMERR;
+		bc->ops = (struct op *) malloc(len * sizeof(struct op));
+		if (!bc->ops)
+			return INT_MEMERR;
+		for (i = 0; i < len; ++i) {
+			rec = bc->data + HEAD_SIZE + i * RECORD_SIZE;
+			n = get_le(rec + 4, 4);
+			bc->ops[i].kind = (int) get_le(rec, 4);
+			bc->ops[i].off = n > 0x7fffffffUL
+				? -(int) (0xffffffffUL - n) - 1 : (int) n;
+			if (get_le(rec, 4) > OP_END ||
+			    !get_arg(rec + 8, &bc->ops[i].arg))
+				return INT_INVL;
+		}
+		prog->ops = bc->ops;
+	}
+
+	return bytecode_valid(prog) ? INT_SUCC : INT_INVL;
+}
+
+/* lets go of a bytecode file and the program loaded from it */
+void bytecode_close(struct bytecode *bc, struct program *prog)
+{
+	free(bc->data);
+	free(bc->ops);
+
+	bc->data = NULL;
+	bc->ops = NULL;
+	prog->ops = NULL;
+}
@@ -0,0 +1,356 @@
+/*
+ * The cache of compiled programs for --cache.
+ *
+ * Compiling and optimizing a program gives the same instructions
+ * every time for the same source, so with --cache they're kept
+ * in a file named after the SHA-256 of the source, the cell
+ * width and whether precompute() was run on it, in
+ * $XDG_CACHE_HOME/bf or ~/.cache/bf, and the next run with the
+ * same source loads them from there instead. The source still
+ * has to be read to hash it, but that's all that's done with it.
+ *
+ * The file has the whole digest in it again, along with the
+ * length of the source, CACHE_VERSION, the cell width, the build
+ * of bf that wrote it and a hash of the instructions, so a file
+ * that doesn't match or got damaged is compiled over instead of
+ * used. A different source would have to have the same SHA-256 to
+ * be mistaken for this one, which nobody knows how to make. The
+ * build is the time cache.c was compiled, which make does
+ * whenever any of bf is, so a change to what compile(),
+ * optimize(), fuse() or precompute() produce never loads what an
+ * older bf left behind. CACHE_VERSION is only for the layout of
+ * the file. The instructions are stored as they are in memory,
+ * so a file is only any good to the build that wrote it anyway.
+ *
+ * Files are written under a temporary name and renamed into
+ * place, so two runs at once never see half of one. Without
+ * POSIX there's no way to make the directory, so nothing is
+ * cached.
+ */
+
+#if defined(__unix__) || defined(__APPLE__)
+#define CACHE_DIRS
+#define _POSIX_C_SOURCE 200809L
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef CACHE_DIRS
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+#endif
+
+#include "bfint.h"
+
+#define CACHE_VERSION 2
+#define CACHE_MAGIC "bf cache"
+#define CACHE_BUILD __DATE__ " " __TIME__	/* which bf wrote a file */
+
+/* a 32-bit FNV-1a hash of some bytes, carrying on from h */
+static unsigned long fnv(unsigned long h, const unsigned char *p, size_t len)
+{
+	while (len--)
+		h = (h ^ *p++) * 16777619UL & 0xffffffffUL;
+
+	return h;
+}
+
+#define FNV_INIT 2166136261UL
+
+/* SHA-256, with all the words kept to 32 bits in unsigned longs */
+struct sha256 {
+	unsigned long h[8];
+	unsigned char block[64];
+	size_t len;	/* bytes hashed so far */
+};
+
+static const unsigned long sha_k[64] = {
+	0x428a2f98UL, 0x71374491UL, 0xb5c0fbcfUL, 0xe9b5dba5UL,
+	0x3956c25bUL, 0x59f111f1UL, 0x923f82a4UL, 0xab1c5ed5UL,
+	0xd807aa98UL, 0x12835b01UL, 0x243185beUL, 0x550c7dc3UL,
+	0x72be5d74UL, 0x80deb1feUL, 0x9bdc06a7UL, 0xc19bf174UL,
+	0xe49b69c1UL, 0xefbe4786UL, 0x0fc19dc6UL, 0x240ca1ccUL,
+	0x2de92c6fUL, 0x4a7484aaUL, 0x5cb0a9dcUL, 0x76f988daUL,
+	0x983e5152UL, 0xa831c66dUL, 0xb00327c8UL, 0xbf597fc7UL,
+	0xc6e00bf3UL, 0xd5a79147UL, 0x06ca6351UL, 0x14292967UL,
+	0x27b70a85UL, 0x2e1b2138UL, 0x4d2c6dfcUL, 0x53380d13UL,
+	0x650a7354UL, 0x766a0abbUL, 0x81c2c92eUL, 0x92722c85UL,
+	0xa2bfe8a1UL, 0xa81a664bUL, 0xc24b8b70UL, 0xc76c51a3UL,
+	0xd192e819UL, 0xd6990624UL, 0xf40e3585UL, 0x106aa070UL,
+	0x19a4c116UL, 0x1e376c08UL, 0x2748774cUL, 0x34b0bcb5UL,
+	0x391c0cb3UL, 0x4ed8aa4aUL, 0x5b9cca4fUL, 0x682e6ff3UL,
+	0x748f82eeUL, 0x78a5636fUL, 0x84c87814UL, 0x8cc70208UL,
+	0x90befffaUL, 0xa4506cebUL, 0xbef9a3f7UL, 0xc67178f2UL
+};
+
+#define ROR(x, n) (((x) >> (n) | (x) << (32 - (n))) & 0xffffffffUL)
+
+static void sha_init(struct sha256 *sha)
+{
+	static const unsigned long h[8] = {
+		0x6a09e667UL, 0xbb67ae85UL, 0x3c6ef372UL, 0xa54ff53aUL,
+		0x510e527fUL, 0x9b05688cUL, 0x1f83d9abUL, 0x5be0cd19UL
+	};
+
+	memcpy(sha->h, h, sizeof(h));
+	sha->len = 0;
+}
+
+/* mixes a whole block into the state */
+static void sha_block(struct sha256 *sha, const unsigned char *p)
+{
+	unsigned long w[64], v[8], s0, s1, t1, t2;
+	int i;
+
+	for (i = 0; i < 16; ++i, p += 4)
+		w[i] = (unsigned long) p[0] << 24 |
+		       (unsigned long) p[1] << 16 |
+		       (unsigned long) p[2] << 8 | p[3];
+	for (; i < 64; ++i) {
+		s0 = ROR(w[i - 15], 7) ^ ROR(w[i - 15], 18) ^ w[i - 15] >> 3;
+		s1 = ROR(w[i - 2], 17) ^ ROR(w[i - 2], 19) ^ w[i - 2] >> 10;
+		w[i] = (w[i - 16] + s0 + w[i - 7] + s1) & 0xffffffffUL;
+	}
+
+	memcpy(v, sha->h, sizeof(v));
+	for (i = 0; i < 64; ++i) {
+		s1 = ROR(v[4], 6) ^ ROR(v[4], 11) ^ ROR(v[4], 25);
+		t1 = (v[7] + s1 + ((v[4] & v[5]) ^ (~v[4] & v[6])) +
+		      sha_k[i] + w[i]) & 0xffffffffUL;
+		s0 = ROR(v[0], 2) ^ ROR(v[0], 13) ^ ROR(v[0], 22);
+		t2 = (s0 + ((v[0] & v[1]) ^ (v[0] & v[2]) ^
+			    (v[1] & v[2]))) & 0xffffffffUL;
+		memmove(v + 1, v, 7 * sizeof(v[0]));
+		v[4] = (v[4] + t1) & 0xffffffffUL;
+		v[0] = (t1 + t2) & 0xffffffffUL;
+	}
+
+	for (i = 0; i < 8; ++i)
+		sha->h[i] = (sha->h[i] + v[i]) & 0xffffffffUL;
+}
+
+static void sha_add(struct sha256 *sha, const unsigned char *p,
+		    size_t len)
+{
+	size_t used = sha->len % 64, n;
+
+	sha->len += len;
+	if (used) {
+		n = len < 64 - used ? len : 64 - used;
+		memcpy(sha->block + used, p, n);
+		p += n;
+		len -= n;
+		if (used + n < 64)
+			return;
+		sha_block(sha, sha->block);
+	}
+	for (; len >= 64; len -= 64, p += 64)
+		sha_block(sha, p);
+	memcpy(sha->block, p, len);
+}
+
+/* pads out the last block and writes the digest as 64 hex digits */
+static void sha_done(struct sha256 *sha, char *hex)
+{
+	unsigned char pad[72];
+	size_t len = sha->len, n = 64 - (len + 8) % 64;
+	int i;
+
+	/* then the length in bits, big-endian */
+	memset(pad, 0, sizeof(pad));
+	pad[0] = 0x80;
+	pad[n + 7] = (unsigned char) (len << 3 & 0xff);
+	for (len >>= 5, i = 6; i >= 0; --i, len >>= 8)
+		pad[n + i] = (unsigned char) (len & 0xff);
+	sha_add(sha, pad, n + 8);
+
+	for (i = 0; i < 8; ++i)
+		sprintf(hex + 8 * i, "%08lx", sha->h[i]);
+}
+
+/*
+ * Hashes the whole source, then goes back to the start of it for
+ * compile(), which is why only files that can seek are cached.
+ *
+ * args: cache to set up, source that hasn't been read yet, bits
+ *       in a cell, whether precompute() is run on the program
+ * returns: 0 for success, with cache->path NULL if the program
+ *          can't be cached, 2 for bad memory allocation, 3 for
+ *          I/O error
+ */
+INT_STAT cache_open(struct cache *cache, struct source *src, int bits,
+		    int ahead)
+{
+#ifdef CACHE_DIRS
+	const char *home, *dir = "";
+	struct sha256 sha;
+	FILE *fp = src->fp;
+	INT_STAT status;
+
+	cache->path = NULL;
+	cache->size = 0;
+	cache->bits = bits;
+
+	home = getenv("XDG_CACHE_HOME");
+	if (!home || !*home) {
+		home = getenv("HOME");
+		dir = "/.cache";
+	}
+	if (!home || !*home || fseek(fp, 0, SEEK_SET))
+		return INT_SUCC;
+
+	sha_init(&sha);
+	while ((status = source_next(src)) == INT_SUCC && src->len) {
+		sha_add(&sha, (const unsigned char *) src->str, src->len);
+		cache->size += src->len;
+	}
+	if (status != INT_SUCC)
+		return status;
+	sha_done(&sha, cache->digest);
+
+	/* and back to the start */
+	source_close(src);
+	if (fseek(fp, 0, SEEK_SET))
+		return INT_IOERR;
+	status = source_open(src, fp);
+	if (status != INT_SUCC)
+		return status;
+
+	cache->path = (char *) malloc(strlen(home) + strlen(dir) + 96);
+	if (!cache->path)
+		return INT_MEMERR;
+	sprintf(cache->path, "%s%s/bf/%s-%d%s", home, dir, cache->digest,
+		bits, ahead ? "" : "-whole");
+#else
+	(void) src;
+	(void) ahead;
+
+	cache->path = NULL;
+	cache->size = 0;
+	cache->bits = bits;
+#endif
+
+	return INT_SUCC;
+}
+
+/*
+ * Loads the program for the source from the cache, if it's there.
+ *
+ * args: cache from cache_open(), program to fill
+ * returns: nonzero if the program was loaded
+ */
+int cache_load(const struct cache *cache, struct program *prog)
+{
+	unsigned long version, bits, size, opsize, len, margin, sum;
+	char digest[66], build[sizeof(CACHE_BUILD) + 1];
+	FILE *fp;
+
+	if (!cache->path)
+		return 0;
+
+	fp = fopen(cache->path, "rb");
+	if (!fp)
+		return 0;
+
+	prog->ops = NULL;
+	if (fscanf(fp, CACHE_MAGIC " %lu %lu %lu %lu %lu %lu %lu", &version,
+		   &bits, &size, &opsize, &len, &margin, &sum) != 7 ||
+	    fgetc(fp) != '\n' || !fgets(digest, sizeof(digest), fp) ||
+	    !fgets(build, sizeof(build), fp) ||
+	    strncmp(digest, cache->digest, 64) || strcmp(digest + 64, "\n") ||
+	    strncmp(build, CACHE_BUILD, sizeof(CACHE_BUILD) - 1) ||
+	    strcmp(build + sizeof(CACHE_BUILD) - 1, "\n") ||
+	    version != CACHE_VERSION || bits != (unsigned long) cache->bits ||
+	    size != (unsigned long) cache->size ||
+	    opsize != sizeof(struct op) || !len ||
+	    len > SIZE_MAX / sizeof(struct op))
+		goto fail;
+
+	prog->ops = (struct op *) malloc(len * sizeof(struct op));
+	if (!prog->ops || fread(prog->ops, sizeof(struct op), len, fp) != len ||
+	    fnv(FNV_INIT, (const unsigned char *) prog->ops,
+		len * sizeof(struct op)) != sum)
+		goto fail;
+
+	prog->pos = NULL;
+	prog->len = prog->cap = len;
+	prog->margin = margin;
+	if (!bytecode_valid(prog))
+		goto fail;
+
+	fclose(fp);
+	return 1;
+
+fail:
+	free(prog->ops);
+	prog->ops = NULL;
+	fclose(fp);
+	return 0;
+}
+
+/*
+ * Stores a compiled program in the cache, making the directory
+ * if it has to. A program that can't be stored just isn't, since
+ * it'll be compiled again next time anyway.
+ *
+ * args: cache from cache_open(), program to store
+ */
+void cache_save(const struct cache *cache, const struct program *prog)
+{
+#ifdef CACHE_DIRS
+	char *tmp, *slash;
+	FILE *fp;
+	int ok;
+
+	if (!cache->path)
+		return;
+
+	tmp = (char *) malloc(strlen(cache->path) + 32);
+	if (!tmp)
+		return;
+
+	/* the directory, and the one it's in if that's missing too */
+	strcpy(tmp, cache->path);
+	*strrchr(tmp, '/') = '\0';
+	if (mkdir(tmp, 0755)) {
+		slash = strrchr(tmp, '/');
+		*slash = '\0';
+		mkdir(tmp, 0755);
+		*slash = '/';
+		mkdir(tmp, 0755);
+	}
+
+	sprintf(tmp, "%s.%ld", cache->path, (long) getpid());
+	fp = fopen(tmp, "wb");
+	if (!fp) {
+		free(tmp);
+		return;
+	}
+
+	ok = fprintf(fp, CACHE_MAGIC " %d %d %lu %lu %lu %lu %lu\n%s\n%s\n",
+		     CACHE_VERSION, cache->bits, (unsigned long) cache->size,
+		     (unsigned long) sizeof(struct op),
+		     (unsigned long) prog->len,
+		     (unsigned long) prog->margin,
+		     fnv(FNV_INIT, (const unsigned char *) prog->ops,
+			 prog->len * sizeof(struct op)),
+		     cache->digest, CACHE_BUILD) > 0 &&
+	     fwrite(prog->ops, sizeof(struct op), prog->len, fp) == prog->len;
+	if (fclose(fp) || !ok || rename(tmp, cache->path))
+		remove(tmp);
+
+	free(tmp);
+#else
+	(void) cache;
+	(void) prog;
+#endif
+}
+
+void cache_close(struct cache *cache)
+{
+	free(cache->path);
+	cache->path = NULL;
+}
@@ -0,0 +1,397 @@
+/*
+ * Checkpoints, for --checkpoint-every and --resume.
+ *
+ * Every so often a long run stops at the end of a loop, see
+ * limit.c, and everything it would need to carry on from there is
+ * written to a file: where it was in the program, the tape and the
+ * pointer, and how much input it had read and output it had
+ * written. --resume loads all of that back and starts from there,
+ * so a job that gets killed only loses what it did since the last
+ * checkpoint.
+ *
+ * A checkpoint file is a 96-byte header and then the tape, with
+ * every number little-endian:
+ *
+ *   0	"bfck"
+ *   4	CHECKPOINT_VERSION
+ *   8	bits in a cell, 8, 16 or 32
+ *   12	1 if stdout was a regular file, 0 if not
+ *   16	checksum of the program, see bytecode_sum()
+ *   24	instruction to carry on from, 64 bits
+ *   32	bytes of input read, 64 bits
+ *   40	bytes of output written, 64 bits
+ *   48	device and inode of stdout, 64 bits each
+ *   64	how far into stdout the output had got, 64 bits
+ *   72	length of the tape in bytes, 64 bits
+ *   80	where the pointer is on it, in bytes, 64 bits
+ *   88	number of chunks of tape, 64 bits
+ *
+ * The tape is only the chunks of TAPE_INIT bytes that aren't all
+ * zero, each after its index, so a huge tape that's mostly empty
+ * makes a small file, the same as it costs little memory, see
+ * tape.c.
+ *
+ * A checkpoint is written under a temporary name and renamed into
+ * place once it's all on disk, so the last one is never lost to
+ * one that was only half written. On POSIX systems a child process
+ * writes it: fork() gives the child a copy-on-write snapshot of the
+ * tape for nothing, so the run carries on at once, and the pages
+ * it goes on to change are the only ones that get copied.
+ *
+ * Output can't be taken back, so the output since a checkpoint is
+ * written again by a run resumed from it. If stdout is the same
+ * regular file it was, as it is with >>, it's cut back to where
+ * it was at the checkpoint first.
+ */
+
+#if defined(__unix__) || defined(__APPLE__)
+#define CHECKPOINT_FORK
+#define _POSIX_C_SOURCE 200809L
+#endif
+
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef CHECKPOINT_FORK
+#include <errno.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+
+#include "bfint.h"
+
+#define CHECKPOINT_VERSION 1
+#define HEAD_SIZE 96
+#define CHUNK TAPE_INIT
+
+static void put_le(unsigned char *p, unsigned long v, int n)
+{
+	while (n--) {
+		*p++ = (unsigned char) (v & 0xff);
+		v >>= 8;
+	}
+}
+
+static unsigned long get_le(const unsigned char *p, int n)
+{
+	unsigned long v = 0;
+
+	while (n--)
+		v = v << 8 | p[n];
+
+	return v;
+}
+
+/* a count, which may not fit in a long where long is 32 bits */
+static void put_count(unsigned char *p, double v)
+{
+	unsigned long hi = (unsigned long) (v / 4294967296.0);
+
+	put_le(p, (unsigned long) (v - hi * 4294967296.0), 4);
+	put_le(p + 4, hi, 4);
+}
+
+static double get_count(const unsigned char *p)
+{
+	return get_le(p, 4) + get_le(p + 4, 4) * 4294967296.0;
+}
+
+/* a number that has to come back exactly, as far as long goes */
+static void put_id(unsigned char *p, unsigned long v)
+{
+	put_le(p, v & 0xffffffffUL, 4);
+	put_le(p + 4, v >> 16 >> 16, 4);
+}
+
+static unsigned long get_id(const unsigned char *p)
+{
+	return get_le(p, 4) | get_le(p + 4, 4) << 16 << 16;
+}
+
+/*
+ * Sets up for a run that may be checkpointed or resumed.
+ *
+ * args: checkpoint state to set up, where to write checkpoints or
+ *       NULL, program to run, bits in a cell
+ */
+void checkpoint_init(struct checkpoint *ck, const char *path,
+		     const struct program *prog, int bits)
+{
+	ck->path = path;
+	ck->bits = bits;
+	bytecode_sum(prog, ck->sum);
+	ck->pc = 0;
+	ck->in = 0;
+	ck->out = 0;
+	ck->dev = 0;
+	ck->ino = 0;
+	ck->at = -1;
+	ck->child = 0;
+}
+
+/* works out which file stdout is and how far into it the output is */
+static void find_output(struct checkpoint *ck)
+{
+#ifdef CHECKPOINT_FORK
+	struct stat st;
+	off_t at;
+
+	ck->at = -1;
+	if (fstat(STDOUT_FILENO, &st) || !S_ISREG(st.st_mode))
+		return;
+	at = lseek(STDOUT_FILENO, 0, SEEK_CUR);
+	if (at < 0)
+		return;
+
+	ck->dev = (unsigned long) st.st_dev;
+	ck->ino = (unsigned long) st.st_ino;
+	ck->at = (double) at;
+#else
+	ck->at = -1;
+#endif
+}
+
+/* returns: nonzero if the len bytes at p aren't all zero */
+static int in_use(const unsigned char *p, size_t len)
+{
+	return *p || memcmp(p, p + 1, len - 1);
+}
+
+/* writes a checkpoint to the file it's for */
+static INT_STAT write_file(const struct checkpoint *ck,
+			   const struct tape *tape)
+{
+	unsigned char head[HEAD_SIZE], idx[8];
+	size_t i, n, chunks = 0, len = strlen(ck->path);
+	char *tmp;
+	FILE *fp;
+	int err;
+
+	tmp = (char *) malloc(len + 32);
+	if (!tmp)
+		return INT_MEMERR;
+#ifdef CHECKPOINT_FORK
+	sprintf(tmp, "%s.%ld", ck->path, (long) getpid());
+#else
+	sprintf(tmp, "%s.tmp", ck->path);
+#endif
+
+	fp = fopen(tmp, "wb");
+	if (!fp) {
+		free(tmp);
+		return INT_IOERR;
+	}
+
+	/* the chunks are counted as they're written, so that goes last */
+	memset(head, 0, HEAD_SIZE);
+	memcpy(head, "bfck", 4);
+	put_le(head + 4, CHECKPOINT_VERSION, 4);
+	put_le(head + 8, (unsigned long) ck->bits, 4);
+	put_le(head + 12, ck->at >= 0, 4);
+	put_le(head + 16, ck->sum[0], 4);
+	put_le(head + 20, ck->sum[1], 4);
+	put_count(head + 24, (double) ck->pc);
+	put_count(head + 32, ck->in);
+	put_count(head + 40, ck->out);
+	put_id(head + 48, ck->dev);
+	put_id(head + 56, ck->ino);
+	put_count(head + 64, ck->at >= 0 ? ck->at : 0);
+	put_count(head + 72, (double) tape->len);
+	put_count(head + 80, (double) tape->origin);
+	err = fwrite(head, 1, HEAD_SIZE, fp) != HEAD_SIZE;
+
+	for (i = 0; !err && i < tape->len; i += n) {
+		n = tape->len - i < CHUNK ? tape->len - i : CHUNK;
+		if (!in_use(tape->cells + i, n))
+			continue;
+		put_count(idx, (double) (i / CHUNK));
+		err = fwrite(idx, 1, 8, fp) != 8 ||
+		      fwrite(tape->cells + i, 1, n, fp) != n;
+		++chunks;
+	}
+
+	put_count(head + 88, (double) chunks);
+	if (!err)
+		err = fseek(fp, 88, SEEK_SET) ||
+		      fwrite(head + 88, 1, 8, fp) != 8;
+	err |= fflush(fp) != 0;
+#ifdef CHECKPOINT_FORK
+	if (!err)
+		err = fsync(fileno(fp)) != 0;
+#endif
+	err |= fclose(fp) != 0;
+
+	if (!err)
+		err = rename(tmp, ck->path) != 0;
+	if (err)
+		remove(tmp);
+	free(tmp);
+
+	return err ? INT_IOERR : INT_SUCC;
+}
+
+/*
+ * Saves a checkpoint of a run that's stopped for one. The output
+ * has to have been flushed, and tape->origin has to be where the
+ * pointer is. The last checkpoint is waited for first, so they're
+ * never written out of order.
+ *
+ * args: checkpoint state, tape, I/O state, instruction the run
+ *       carries on from
+ * returns: 0 for success, 2 for bad memory allocation, 3 if this
+ *          or the last checkpoint couldn't be written
+ */
+INT_STAT checkpoint_save(struct checkpoint *ck, const struct tape *tape,
+			 const struct io *io, size_t pc)
+{
+	INT_STAT status = checkpoint_wait(ck);
+#ifdef CHECKPOINT_FORK
+	pid_t pid;
+#endif
+
+	if (status != INT_SUCC)
+		return status;
+
+	ck->pc = pc;
+	ck->in = io_read(io);
+	ck->out = io->nout;
+	find_output(ck);
+
+#ifdef CHECKPOINT_FORK
+	/* if there's no child to be had, it's written here instead */
+	pid = fork();
+	if (!pid)
+		_exit(write_file(ck, tape) != INT_SUCC);
+	if (pid > 0) {
+		ck->child = (long) pid;
+		return INT_SUCC;
+	}
+#endif
+
+	return write_file(ck, tape);
+}
+
+/*
+ * Waits for the last checkpoint to be written, if it's still
+ * being written.
+ *
+ * returns: 0 for success, 3 if it couldn't be written
+ */
+INT_STAT checkpoint_wait(struct checkpoint *ck)
+{
+#ifdef CHECKPOINT_FORK
+	pid_t pid = (pid_t) ck->child;
+	int st;
+
+	if (!pid)
+		return INT_SUCC;
+	ck->child = 0;
+
+	while (waitpid(pid, &st, 0) < 0)
+		if (errno != EINTR)
+			return INT_IOERR;
+
+	return WIFEXITED(st) && !WEXITSTATUS(st) ? INT_SUCC : INT_IOERR;
+#else
+	(void) ck;
+
+	return INT_SUCC;
+#endif
+}
+
+/*
+ * Loads a checkpoint to resume a run from, onto an empty tape.
+ *
+ * args: checkpoint state from checkpoint_init() for the program
+ *       that's about to run, open file, that program, tape
+ * returns: 0 for success, 1 for a file that isn't a checkpoint of
+ *          the program, 2 for bad memory allocation or a tape
+ *          longer than it's allowed to be, 3 for I/O error
+ */
+INT_STAT checkpoint_load(struct checkpoint *ck, FILE *fp,
+			 const struct program *prog, struct tape *tape)
+{
+	unsigned char head[HEAD_SIZE], idx[8];
+	double len, pos, chunks, pc, i;
+	size_t at, n, width = tape->width;
+
+	if (fread(head, 1, HEAD_SIZE, fp) != HEAD_SIZE)
+		return ferror(fp) ? INT_IOERR : INT_INVL;
+
+	if (memcmp(head, "bfck", 4) ||
+	    get_le(head + 4, 4) != CHECKPOINT_VERSION ||
+	    get_le(head + 8, 4) != (unsigned long) ck->bits ||
+	    get_le(head + 12, 4) > 1 ||
+	    get_le(head + 16, 4) != ck->sum[0] ||
+	    get_le(head + 20, 4) != ck->sum[1])
+		return INT_INVL;
+
+	/* a run only ever stops just inside a loop */
+	pc = get_count(head + 24);
+	len = get_count(head + 72);
+	pos = get_count(head + 80);
+	chunks = get_count(head + 88);
+	if (pc >= (double) prog->len ||
+	    (pc && prog->ops[(size_t) pc - 1].kind != OP_JZ) ||
+	    len < (double) width || len > (double) (SIZE_MAX / 2) ||
+	    (size_t) len % width || pos >= len || (size_t) pos % width)
+		return INT_INVL;
+
+	ck->pc = (size_t) pc;
+	ck->in = get_count(head + 32);
+	ck->out = get_count(head + 40);
+	ck->dev = get_id(head + 48);
+	ck->ino = get_id(head + 56);
+	ck->at = get_le(head + 12, 4) ? get_count(head + 64) : -1;
+
+	if ((size_t) len > tape->len &&
+	    ((size_t) len / width - 1 > (unsigned long) LONG_MAX ||
+	     !tape_grow(tape, tape->cells, (long) ((size_t) len / width - 1))))
+		return INT_MEMERR;
+
+	for (i = 0; i < chunks; ++i) {
+		if (fread(idx, 1, 8, fp) != 8)
+			return ferror(fp) ? INT_IOERR : INT_INVL;
+		if (get_count(idx) * CHUNK >= len)
+			return INT_INVL;
+		at = (size_t) get_count(idx) * CHUNK;
+		n = (size_t) len - at < CHUNK ? (size_t) len - at : CHUNK;
+		if (fread(tape->cells + at, 1, n, fp) != n)
+			return ferror(fp) ? INT_IOERR : INT_INVL;
+	}
+	if (getc(fp) != EOF)
+		return INT_INVL;
+	if (ferror(fp))
+		return INT_IOERR;
+
+	tape->origin = (size_t) pos;
+
+	return INT_SUCC;
+}
+
+/*
+ * Cuts stdout back to where the output was at a checkpoint that's
+ * being resumed from, if it's the same file and it got that far.
+ * Otherwise it's left alone.
+ */
+void checkpoint_output(const struct checkpoint *ck)
+{
+#ifdef CHECKPOINT_FORK
+	struct stat st;
+
+	if (ck->at < 0 || fstat(STDOUT_FILENO, &st) || !S_ISREG(st.st_mode) ||
+	    (unsigned long) st.st_dev != ck->dev ||
+	    (unsigned long) st.st_ino != ck->ino ||
+	    (double) st.st_size < ck->at)
+		return;
+
+	if (!ftruncate(STDOUT_FILENO, (off_t) ck->at))
+		lseek(STDOUT_FILENO, (off_t) ck->at, SEEK_SET);
+#else
+	(void) ck;
+#endif
+}
@@ -0,0 +1,893 @@
+/*
+ * The compiler, which turns brainfuck source into the instructions
+ * in bfint.h, and the passes that make those faster to run.
+ *
+ * A big piece of source is split into shares that are compiled on
+ * threads of their own, each into a program of its own, and then
+ * stitched back together in order, see stitch(). Every command is
+ * a single byte, so a share can start anywhere. Without POSIX
+ * there are no threads, and every piece is compiled in one go.
+ */
+
+#if defined(__unix__) || defined(__APPLE__)
+#define COMPILE_THREADS
+#define _POSIX_C_SOURCE 200809L
+#define _DEFAULT_SOURCE
+#define _DARWIN_C_SOURCE
+#endif
+
+#include <limits.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef COMPILE_THREADS
+#include <pthread.h>
+#include <unistd.h>
+#endif
+
+#include "bfint.h"
+
+#define PROG_INIT 64
+#define LOOP_MAX 16	/* most cells a loop may touch to be rewritten */
+#define FUSE_MAX 256	/* furthest fuse() puts a cell from the pointer */
+/*
+ * The cells precompute() has to work with. It can set cells up to
+ * half of them away from the pointer, which raises the margin the
+ * engines reserve on both sides. At 32 bits a cell, that still
+ * fits in the TAPE_LEAST bytes any tape is allowed, so turning the
+ * optimizer on can't make a program run off a --max-tape it fits.
+ */
+#define PREFIX_CELLS (TAPE_LEAST / 8)
+#define PREFIX_OUT 4096	/* most output precompute() keeps */
+#define PREFIX_STEPS (1L << 20)	/* most instructions precompute() runs */
+#define SHARE_MIN (1UL << 20)	/* fewest bytes of source for a thread */
+#define SHARE_MAX 64	/* most threads compiling one piece */
+
+/*
+ * Makes room for n more instructions at the end of the program.
+ *
+ * returns: 0 for success, 2 for bad memory allocation
+ */
+static INT_STAT reserve(struct program *prog, size_t n)
+{
+	struct op *ops;
+	size_t *pos, cap = prog->cap;
+
+	if (cap - prog->len >= n)
+		return INT_SUCC;
+
+	while (cap - prog->len < n) {
+		if (cap > SIZE_MAX / 2 / sizeof(struct op))
+			return INT_MEMERR;
+		cap *= 2;
+	}
+
+	ops = (struct op *) realloc(prog->ops, cap * sizeof(struct op));
+	if (!ops)
+		return INT_MEMERR;
+	prog->ops = ops;
+
+	if (prog->pos) {
+		pos = (size_t *) realloc(prog->pos, cap * sizeof(size_t));
+		if (!pos)
+			return INT_MEMERR;
+		prog->pos = pos;
+	}
+
+	prog->cap = cap;
+
+	return INT_SUCC;
+}
+
+/*
+ * Appends an instruction to the program, growing it as needed.
+ *
+ * args: program to append to, kind of instruction, argument,
+ *       where in the source it came from
+ * returns: 0 for success, 2 for bad memory allocation
+ */
+static INT_STAT emit(struct program *prog, int kind, long arg, size_t at)
+{
+	if (reserve(prog, 1) != INT_SUCC)
+		return INT_MEMERR;
+
+	prog->ops[prog->len].kind = kind;
+	prog->ops[prog->len].off = 0;
+	prog->ops[prog->len].arg = arg;
+	if (prog->pos)
+		prog->pos[prog->len] = at;
+	++prog->len;
+
+	return INT_SUCC;
+}
+
+/*
+ * Starts an empty program, with room for source offsets if
+ * positions is nonzero. Nothing is left to free if it fails.
+ *
+ * returns: 0 for success, 2 for bad memory allocation
+ */
+static INT_STAT start(struct program *prog, int positions)
+{
+	prog->ops = (struct op *) malloc(PROG_INIT * sizeof(struct op));
+	prog->pos = NULL;
+	prog->len = 0;
+	prog->cap = PROG_INIT;
+	prog->margin = 0;
+	if (!prog->ops)
+		return INT_MEMERR;
+
+	if (positions) {
+		prog->pos = (size_t *) malloc(PROG_INIT * sizeof(size_t));
+		if (!prog->pos) {
+			free(prog->ops);
+			prog->ops = NULL;
+			return INT_MEMERR;
+		}
+	}
+
+	return INT_SUCC;
+}
+
+/*
+ * The brackets compile_piece() has got to. While a bracket is
+ * still open, its JZ holds the index of the enclosing open one,
+ * so the JZs double as a stack, with open at the top and bottom
+ * at the bottom. A ] with nothing open closes a bracket from
+ * before the program started, which is an error in a whole
+ * program but not in a share of one, see stitch(). Those JNZs
+ * make a list the same way, from first to last, each holding the
+ * index of the next. Any of them is -1 if there are none.
+ */
+struct brackets {
+	long open;
+	long bottom;
+	long first;
+	long last;
+};
+
+/*
+ * Compiles one piece of brainfuck source, carrying on from where
+ * the last piece left off. All characters that are not brainfuck
+ * commands are ignored.
+ *
+ * Consecutive + and - (or < and >) are summed into one ADD (or
+ * MOVE), which is dropped again if the sum is zero. That carries
+ * on across pieces too, since the last instruction is still at
+ * the end of the program. A sum that gets as far as LONG_MAX or
+ * LONG_MIN starts a new instruction instead of overflowing.
+ *
+ * Brackets are matched as they are compiled, see struct brackets.
+ *
+ * args: program being compiled, its brackets, piece of source,
+ *       size of piece, where it starts in the source
+ * returns: 0 for success, 2 for bad memory allocation
+ */
+static INT_STAT compile_piece(struct program *prog, struct brackets *br,
+			      const char *str, size_t len, size_t base)
+{
+	struct op *last;
+	long arg;
+	int kind;
+	size_t i;
+
+	for (i = 0; i < len; ++i) {
+		switch (str[i]) {
+		case '+': kind = OP_ADD;  arg = 1;        break;
+		case '-': kind = OP_ADD;  arg = -1;       break;
+		case '>': kind = OP_MOVE; arg = 1;        break;
+		case '<': kind = OP_MOVE; arg = -1;       break;
+		case '.': kind = OP_OUT;  arg = 0;        break;
+		case ',': kind = OP_IN;   arg = 0;        break;
+		case '[': kind = OP_JZ;   arg = br->open; break;
+		case ']': kind = OP_JNZ;  arg = br->open; break;
+		default:
+			continue; /* nothing */
+		}
+
+		last = prog->len ? &prog->ops[prog->len - 1] : NULL;
+
+		if ((kind == OP_ADD || kind == OP_MOVE) &&
+		    last && last->kind == kind &&
+		    last->arg != (arg > 0 ? LONG_MAX : LONG_MIN)) {
+			last->arg += arg;
+			if (!last->arg)
+				--prog->len;
+			continue;
+		}
+
+		if (kind == OP_JNZ && br->open == -1) {
+			if (br->last == -1)
+				br->first = prog->len;
+			else
+				prog->ops[br->last].arg = prog->len;
+			br->last = prog->len;
+		} else if (kind == OP_JNZ) {
+			br->open = prog->ops[arg].arg;
+			prog->ops[arg].arg = prog->len;
+		} else if (kind == OP_JZ) {
+			if (br->open == -1)
+				br->bottom = prog->len;
+			br->open = prog->len;
+		}
+
+		if (emit(prog, kind, arg, base + i) != INT_SUCC)
+			return INT_MEMERR;
+	}
+
+	return INT_SUCC;
+}
+
+/*
+ * A share of a piece of source, and the program it compiles to
+ * on its own, with its own brackets.
+ */
+struct share {
+	struct program prog;
+	struct brackets br;
+	const char *str;
+	size_t len;
+	size_t base;
+	INT_STAT status;
+	int started;	/* whether it's on a thread of its own */
+#ifdef COMPILE_THREADS
+	pthread_t tid;
+#endif
+};
+
+/* compiles a share, as a thread or not */
+static void *compile_share(void *arg)
+{
+	struct share *sh = (struct share *) arg;
+
+	sh->br.open = sh->br.bottom = sh->br.first = sh->br.last = -1;
+	sh->status = compile_piece(&sh->prog, &sh->br, sh->str, sh->len,
+				   sh->base);
+
+	return NULL;
+}
+
+/*
+ * Appends a compiled share to the program, so that it comes out
+ * the same as if the share had been compiled onto the end of it.
+ * The one difference is that where a sum came to zero across the
+ * join, the instruction after it can keep the source offset of a
+ * + or - from before the one it would have had, which is still in
+ * the same run of them.
+ *
+ * The ADDs (or MOVEs) at the start of the share are summed into
+ * the end of the program, the same as compile_piece() does, and
+ * the rest moves along after it. Then the list of JNZs closing
+ * brackets from before the share closes the innermost brackets
+ * still open in the program, and the share's own open brackets go
+ * on top of what's left. Only the brackets a share leaves
+ * unmatched have to be looked at here, because compile_piece()
+ * already matched the rest, so this is quick however big the
+ * share was.
+ *
+ * args: program being compiled, its brackets, compiled share
+ * returns: 0 for success, 1 for unmatched brackets,
+ *          2 for bad memory allocation
+ */
+static INT_STAT stitch(struct program *prog, struct brackets *br,
+		       const struct share *sh)
+{
+	const struct op *from = sh->prog.ops;
+	struct op *ops, *last;
+	size_t i, k, n = sh->prog.len;
+	long shift, j, next, z;
+
+	for (i = 0; i < n && prog->len; ++i) {
+		last = &prog->ops[prog->len - 1];
+		if ((from[i].kind != OP_ADD && from[i].kind != OP_MOVE) ||
+		    last->kind != from[i].kind ||
+		    (from[i].arg > 0 ? last->arg > LONG_MAX - from[i].arg
+				     : last->arg < LONG_MIN - from[i].arg))
+			break;
+		last->arg += from[i].arg;
+		if (!last->arg)
+			--prog->len;
+	}
+
+	if (reserve(prog, n - i) != INT_SUCC)
+		return INT_MEMERR;
+
+	/* indices in the share all move by the same amount */
+	ops = prog->ops;
+	shift = (long) prog->len - (long) i;
+	for (k = prog->len; i < n; ++i, ++k) {
+		ops[k] = from[i];
+		if ((ops[k].kind == OP_JZ || ops[k].kind == OP_JNZ) &&
+		    ops[k].arg != -1)
+			ops[k].arg += shift;
+		if (prog->pos)
+			prog->pos[k] = sh->prog.pos[i];
+	}
+	prog->len = k;
+
+	j = sh->br.first == -1 ? -1 : sh->br.first + shift;
+	for (; j != -1; j = next) {
+		if (br->open == -1)
+			return INT_INVL;
+		next = ops[j].arg;
+		z = br->open;
+		br->open = ops[z].arg;
+		ops[z].arg = j;
+		ops[j].arg = z;
+	}
+
+	if (sh->br.open != -1) {
+		ops[sh->br.bottom + shift].arg = br->open;
+		if (br->open == -1)
+			br->bottom = sh->br.bottom + shift;
+		br->open = sh->br.open + shift;
+	}
+
+	return INT_SUCC;
+}
+
+/* how many shares a piece of len bytes is worth splitting into */
+static int shares(size_t len)
+{
+#if defined(COMPILE_THREADS) && defined(_SC_NPROCESSORS_ONLN)
+	long n = sysconf(_SC_NPROCESSORS_ONLN);
+
+	if (n > SHARE_MAX)
+		n = SHARE_MAX;
+	if ((size_t) n > len / SHARE_MIN)
+		n = (long) (len / SHARE_MIN);
+
+	return n < 1 ? 1 : (int) n;
+#else
+	(void) len;
+
+	return 1;
+#endif
+}
+
+/*
+ * Compiles a piece of source in n shares, the first onto the end
+ * of the program on this thread and each of the others into a
+ * program of its own from sh, on a thread of its own, and then
+ * stitches those on in order as they're done. A share whose
+ * thread can't be started is compiled here once the first is.
+ * The programs in sh are kept from one piece to the next, so
+ * they only have to grow the once.
+ *
+ * args: program being compiled, its brackets, room for n - 1
+ *       shares, piece of source, size of piece, where it starts in
+ *       the source, number of shares
+ * returns: 0 for success, 1 for unmatched brackets,
+ *          2 for bad memory allocation
+ */
+static INT_STAT compile_shared(struct program *prog, struct brackets *br,
+			       struct share *sh, const char *str,
+			       size_t len, size_t base, int n)
+{
+	struct share *s;
+	INT_STAT status;
+	size_t size = len / n, at = size;
+	int i;
+
+	for (s = sh; s < sh + n - 1; ++s) {
+		s->str = str + at;
+		s->len = s == sh + n - 2 ? len - at : size;
+		s->base = base + at;
+		s->started = 0;
+		at += s->len;
+
+		s->status = s->prog.ops ? INT_SUCC
+					: start(&s->prog, prog->pos != NULL);
+		s->prog.len = 0;
+		if (s->status != INT_SUCC)
+			continue;
+#ifdef COMPILE_THREADS
+		s->started = !pthread_create(&s->tid, NULL, compile_share, s);
+#endif
+	}
+
+	status = compile_piece(prog, br, str, size, base);
+
+	for (i = 0; i < n - 1; ++i) {
+		s = &sh[i];
+#ifdef COMPILE_THREADS
+		if (s->started)
+			pthread_join(s->tid, NULL);
+#endif
+		if (!s->started && s->status == INT_SUCC &&
+		    status == INT_SUCC)
+			compile_share(s);
+		if (status == INT_SUCC)
+			status = s->status;
+		if (status == INT_SUCC)
+			status = stitch(prog, br, s);
+	}
+
+	return status;
+}
+
+/*
+ * Compiles a source file into instructions for the engines. The
+ * source is compiled a piece at a time as it's read, so only
+ * the compiled program has to fit in memory, not the file, and a
+ * piece that's big enough is split between threads.
+ *
+ * If asked to, it also keeps track of where in the source each
+ * instruction came from, for the profiler.
+ *
+ * args: empty program to fill, source to read, nonzero to keep
+ *       track of source offsets
+ * returns: 0 for success, 1 for unmatched brackets,
+ *          2 for bad memory allocation, 3 for I/O error
+ */
+INT_STAT compile(struct program *prog, struct source *src,
+			int positions)
+{
+	struct share sh[SHARE_MAX - 1];
+	struct brackets br;
+	size_t base = 0;
+	INT_STAT status;
+	int i;
+
+	br.open = br.bottom = br.first = br.last = -1;
+	for (i = 0; i < SHARE_MAX - 1; ++i) {
+		sh[i].prog.ops = NULL;
+		sh[i].prog.pos = NULL;
+	}
+
+	if (start(prog, positions) != INT_SUCC)
+		return INT_MEMERR;
+
+	while ((status = source_next(src)) == INT_SUCC && src->len) {
+		status = compile_shared(prog, &br, sh, src->str, src->len,
+					base, shares(src->len));
+		if (status == INT_SUCC && br.first != -1)
+			status = INT_INVL;
+		if (status != INT_SUCC)
+			break;
+		base += src->len;
+	}
+
+	for (i = 0; i < SHARE_MAX - 1; ++i) {
+		free(sh[i].prog.ops);
+		free(sh[i].prog.pos);
+	}
+
+	if (status != INT_SUCC)
+		return status;
+
+	if (br.open != -1)
+		return INT_INVL;
+
+	return emit(prog, OP_END, 0, base);
+}
+
+/*
+ * Works out whether the body of a loop is one of the idioms that
+ * optimize() knows about, and if so, what to replace the loop
+ * with. The idioms are:
+ *
+ *   [>] and [<]		SCAN, moving by the same amount
+ *   [-] and [+]		SET 0, and so is any other loop that adds
+ *			an odd number to the cell, since it has to
+ *			reach zero eventually
+ *   [->+>++<<]		one MUL per cell the loop adds to, then a
+ *			SET 0, as long as the loop only adds and
+ *			moves, ends up where it started and adds
+ *			1 or -1 to the current cell
+ *
+ * MUL works for loops that add 1 as well as -1, since running
+ * such a loop n times is the same as running it -n times with
+ * every other addition negated, modulo the size of a cell.
+ *
+ * args: body of the loop, number of instructions in it,
+ *       room for LOOP_MAX + 1 replacement instructions
+ * returns: number of replacement instructions, 0 if none
+ */
+static size_t rewrite_loop(const struct op *body, size_t n, struct op *repl)
+{
+	long off = 0, delta[LOOP_MAX];
+	int cell[LOOP_MAX];
+	size_t i, j, cells = 1;
+
+	if (n == 1 && body->kind == OP_MOVE) {
+		repl->kind = OP_SCAN;
+		repl->off = 0;
+		repl->arg = body->arg;
+		return 1;
+	}
+
+	cell[0] = 0;
+	delta[0] = 0;
+
+	for (i = 0; i < n; ++i) {
+		if (body[i].kind == OP_MOVE) {
+			off += body[i].arg;
+			if (off > INT_MAX || off < -INT_MAX)
+				return 0;
+			continue;
+		}
+
+		if (body[i].kind != OP_ADD)
+			return 0;
+
+		for (j = 0; j < cells && cell[j] != off; ++j)
+			;
+		if (j == cells) {
+			if (cells == LOOP_MAX)
+				return 0;
+			cell[j] = (int) off;
+			delta[j] = 0;
+			++cells;
+		}
+		delta[j] += body[i].arg;
+	}
+
+	if (off || !(cells == 1 ? delta[0] % 2 : delta[0] == 1 ||
+				       delta[0] == -1))
+		return 0;
+
+	for (i = 1, j = 0; i < cells; ++i) {
+		if (!delta[i])
+			continue;
+		repl[j].kind = OP_MUL;
+		repl[j].off = cell[i];
+		repl[j].arg = delta[0] == -1 ? delta[i] : -delta[i];
+		++j;
+	}
+
+	repl[j].kind = OP_SET;
+	repl[j].off = 0;
+	repl[j].arg = 0;
+
+	return j + 1;
+}
+
+/*
+ * Appends an instruction to the part of the program optimize()
+ * or fuse() has already rewritten, merging it with the previous
+ * one if they both just change the same cell. A merged
+ * instruction keeps the source offset of the first one.
+ *
+ * args: program, number of rewritten instructions, instruction,
+ *       its source offset
+ */
+static void push(struct program *prog, size_t *len, const struct op *op,
+		 size_t at)
+{
+	struct op *ops = prog->ops, *last = *len ? &ops[*len - 1] : NULL;
+
+	if (last && (last->kind == OP_ADD || last->kind == OP_SET) &&
+	    last->off == op->off) {
+		if (op->kind == OP_SET) {
+			*last = *op;
+			return;
+		}
+		if (op->kind == OP_ADD) {
+			last->arg += op->arg;
+			if (last->kind == OP_ADD && !last->arg)
+				--*len;
+			return;
+		}
+	}
+
+	if (prog->pos)
+		prog->pos[*len] = at;
+	ops[(*len)++] = *op;
+}
+
+/*
+ * Replaces the loop idioms described at rewrite_loop(). The
+ * program is rewritten in place, since none of the rewrites make
+ * it any longer, and the brackets are matched up again as they
+ * go, the same way compile() does it.
+ *
+ * args: program from compile()
+ */
+void optimize(struct program *prog)
+{
+	struct op repl[LOOP_MAX + 1], *ops = prog->ops;
+	size_t *pos = prog->pos, i, j, k, n, len = 0;
+	long open = -1;
+
+	for (i = 0; i < prog->len; ++i) {
+		if (ops[i].kind == OP_JZ) {
+			ops[i].arg = open;
+			open = len;
+			if (pos)
+				pos[len] = pos[i];
+			ops[len++] = ops[i];
+			continue;
+		}
+
+		if (ops[i].kind != OP_JNZ) {
+			push(prog, &len, &ops[i], pos ? pos[i] : 0);
+			continue;
+		}
+
+		j = open;
+		open = ops[j].arg;
+		n = rewrite_loop(&ops[j + 1], len - j - 1, repl);
+
+		/* the replacement comes from where the loop started */
+		if (n) {
+			len = j;
+			for (k = 0; k < n; ++k) {
+				push(prog, &len, &repl[k], pos ? pos[j] : 0);
+				if ((size_t) abs(repl[k].off) > prog->margin)
+					prog->margin = abs(repl[k].off);
+			}
+		} else {
+			ops[j].arg = len;
+			if (pos)
+				pos[len] = pos[i];
+			ops[len] = ops[i];
+			ops[len++].arg = j;
+		}
+	}
+
+	prog->len = len;
+}
+
+/*
+ * Folds the moves between instructions that only touch one cell
+ * into those instructions, so that >+>++<<- becomes ADD 1 at
+ * offset 1, ADD 2 at offset 2 and ADD -1 at offset 0, and no
+ * moves at all. The pointer only has to really be there when an
+ * instruction looks at the current cell or moves it itself, so
+ * the moves saved up until then are made all at once just before
+ * brackets, MUL, SCAN and the end, or when they'd leave a cell
+ * more than FUSE_MAX cells from the pointer. Like optimize(), it
+ * works in place and matches up the brackets again.
+ *
+ * args: program from optimize()
+ */
+void fuse(struct program *prog)
+{
+	struct op *ops = prog->ops, op, move;
+	size_t *pos = prog->pos, i, j, len = 0, at = 0;
+	long open = -1, shift = 0;
+
+	move.kind = OP_MOVE;
+	move.off = 0;
+
+	for (i = 0; i < prog->len; ++i) {
+		op = ops[i];
+
+		if (op.kind == OP_ADD || op.kind == OP_SET ||
+		    op.kind == OP_OUT || op.kind == OP_IN) {
+			op.off += (int) shift;
+			if ((size_t) abs(op.off) > prog->margin)
+				prog->margin = abs(op.off);
+			push(prog, &len, &op, pos ? pos[i] : 0);
+			continue;
+		}
+
+		/* moves too far to fold are made as they are */
+		if (op.kind == OP_MOVE && labs(op.arg) <= FUSE_MAX &&
+		    labs(shift + op.arg) <= FUSE_MAX) {
+			if (!shift)
+				at = pos ? pos[i] : 0;
+			shift += op.arg;
+			continue;
+		}
+
+		/* everything else needs the pointer where it really is */
+		if (shift) {
+			move.arg = shift;
+			push(prog, &len, &move, at);
+			shift = 0;
+		}
+
+		if (op.kind == OP_JZ) {
+			op.arg = open;
+			open = len;
+		} else if (op.kind == OP_JNZ) {
+			j = open;
+			open = ops[j].arg;
+			ops[j].arg = len;
+			op.arg = j;
+		}
+		push(prog, &len, &op, pos ? pos[i] : 0);
+	}
+
+	prog->len = len;
+}
+
+/* the scratch tape and output of precompute() */
+struct prefix {
+	unsigned long *cells;
+	long ptr;
+	unsigned char *out;
+	size_t nout;
+};
+
+/*
+ * Runs a program from the start on an empty scratch tape, until
+ * it reads input, ends, runs off the scratch tape, writes more
+ * than PREFIX_OUT bytes or has run PREFIX_STEPS instructions,
+ * whichever comes first.
+ *
+ * args: program, scratch state to run on, mask for a cell,
+ *       instruction outside any loop to stop before, where to
+ *       say whether it stopped inside a loop
+ * returns: the last instruction outside any loop it got to
+ */
+static size_t run_prefix(const struct program *prog, struct prefix *s,
+			 unsigned long mask, size_t stop, int *inside)
+{
+	const struct op *op;
+	unsigned long *cells = s->cells;
+	long p = PREFIX_CELLS / 2, q, steps = 0;
+	size_t pc, top = 0, depth = 0;
+
+	/* handlers continue for the next instruction and break to stop */
+	for (pc = 0; ; ++pc) {
+		if (!depth) {
+			top = pc;
+			if (pc == stop)
+				break;
+		}
+		if (steps++ == PREFIX_STEPS)
+			break;
+
+		op = &prog->ops[pc];
+		q = p + op->off;
+		if (q < 0 || q >= PREFIX_CELLS)
+			break;
+
+		switch (op->kind) {
+		case OP_ADD:
+			cells[q] = (cells[q] + (unsigned long) op->arg) & mask;
+			continue;
+		case OP_MOVE:
+			if (op->arg < -p || op->arg >= PREFIX_CELLS - p)
+				break;
+			p += op->arg;
+			continue;
+		case OP_OUT:
+			if (s->nout == PREFIX_OUT)
+				break;
+			s->out[s->nout++] = (unsigned char) cells[q];
+			continue;
+		case OP_JZ:
+			if (!cells[p])
+				pc = op->arg;
+			else
+				++depth;
+			continue;
+		case OP_JNZ:
+			if (cells[p])
+				pc = op->arg;
+			else
+				--depth;
+			continue;
+		case OP_SET:
+			cells[q] = (unsigned long) op->arg & mask;
+			continue;
+		case OP_MUL:
+			cells[q] = (cells[q] + cells[p] *
+				    (unsigned long) op->arg) & mask;
+			continue;
+		case OP_SCAN:
+			for (q = p; cells[q] && op->arg >= -q &&
+				    op->arg < PREFIX_CELLS - q; q += op->arg)
+				;
+			if (cells[q])
+				break;
+			p = q;
+			continue;
+		}
+		break;
+	}
+
+	s->ptr = p;
+	*inside = depth != 0;
+
+	return top;
+}
+
+/* a cell's value as the argument of a SET */
+static long set_arg(unsigned long v, unsigned long mask)
+{
+	return v <= LONG_MAX ? (long) v : -(long) (mask - v) - 1;
+}
+
+static void put_op(struct op *op, int kind, int off, long arg)
+{
+	op->kind = kind;
+	op->off = off;
+	op->arg = arg;
+}
+
+/*
+ * Runs as much of the start of the program as doesn't need any
+ * input, see run_prefix(), and replaces it with the result: the
+ * output it wrote, as a SET and an OUT for each byte, then a SET
+ * for each cell it left nonzero and a move to where it left the
+ * pointer. That can only be done where it got to outside of any
+ * loop, so if it had to stop inside one, it runs again up to
+ * where that loop started. The program is left as it was if it
+ * needs input straight away.
+ *
+ * args: program from fuse(), without source offsets, bits in a
+ *       cell
+ * returns: 0 for success, 2 for bad memory allocation
+ */
+INT_STAT precompute(struct program *prog, int bits)
+{
+	const long mid = PREFIX_CELLS / 2;
+	unsigned long mask = 0xffffffffUL >> (32 - bits);
+	struct prefix s;
+	struct op *ops;
+	size_t top, i, k, len;
+	int inside;
+	long c;
+
+	s.cells = (unsigned long *) calloc(PREFIX_CELLS,
+					   sizeof(unsigned long));
+	s.out = (unsigned char *) malloc(PREFIX_OUT);
+	s.nout = 0;
+	if (!s.cells || !s.out) {
+		free(s.cells);
+		free(s.out);
+		return INT_MEMERR;
+	}
+
+	top = run_prefix(prog, &s, mask, (size_t) -1, &inside);
+	if (top && inside) {
+		memset(s.cells, 0, PREFIX_CELLS * sizeof(unsigned long));
+		s.nout = 0;
+		run_prefix(prog, &s, mask, top, &inside);
+	}
+
+	if (!top) {
+		free(s.cells);
+		free(s.out);
+		return INT_SUCC;
+	}
+
+	/* the output goes through the cell the program started on */
+	len = 2 * s.nout + (s.ptr != mid) + prog->len - top;
+	for (c = 0; c < PREFIX_CELLS; ++c)
+		if (s.cells[c] || (s.nout && c == mid))
+			++len;
+
+	ops = (struct op *) malloc(len * sizeof(struct op));
+	if (!ops) {
+		free(s.cells);
+		free(s.out);
+		return INT_MEMERR;
+	}
+
+	for (i = k = 0; i < s.nout; ++i) {
+		put_op(&ops[k++], OP_SET, 0, s.out[i]);
+		put_op(&ops[k++], OP_OUT, 0, 0);
+	}
+	for (c = 0; c < PREFIX_CELLS; ++c) {
+		if (!s.cells[c] && !(s.nout && c == mid))
+			continue;
+		put_op(&ops[k++], OP_SET, (int) (c - mid),
+		       set_arg(s.cells[c], mask));
+		if ((size_t) labs(c - mid) > prog->margin)
+			prog->margin = labs(c - mid);
+	}
+	if (s.ptr != mid)
+		put_op(&ops[k++], OP_MOVE, 0, s.ptr - mid);
+
+	/* the rest moves along by the difference */
+	for (i = top; i < prog->len; ++i, ++k) {
+		ops[k] = prog->ops[i];
+		if (ops[k].kind == OP_JZ || ops[k].kind == OP_JNZ)
+			ops[k].arg += (long) k - (long) i;
+	}
+
+	free(prog->ops);
+	prog->ops = ops;
+	prog->len = prog->cap = len;
+
+	free(s.cells);
+	free(s.out);
+
+	return INT_SUCC;
+}
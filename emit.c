@@ -0,0 +1,800 @@
+/*
+ * Ahead-of-time compilation: translates an optimized program into
+ * a standalone C or assembly source file, which a system compiler
+ * can then build into a native executable.
+ *
+ * The generated programs behave the same as running the source
+ * with bf: the tape grows in both directions, output is flushed
+ * before every read, and bad memory allocations and I/O errors
+ * are reported the same way.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "bfint.h"
+
+#define C_WRITE_MAX 64	/* most bytes of output in one string literal */
+
+/*
+ * The generated C program, apart from the instructions. ISO C
+ * compilers don't have to support string literals longer than
+ * 509 characters, so it is kept as an array of lines.
+ */
+static const char *const c_head[] = {
+	"#include <stdio.h>",
+	"#include <stdlib.h>",
+	"#include <string.h>",
+	"",
+	"static const char *name;",
+	"static CELL *cells, *lo, *hi;",
+	"static size_t len;",
+	"",
+	"static void fail(const char *msg)",
+	"{",
+	"\tprintf(\"%s: error: %s\\n\", name, msg);",
+	"\texit(EXIT_FAILURE);",
+	"}",
+	"",
+	"static CELL *grow(CELL *p, long n)",
+	"{",
+	"\tsize_t pos = p - cells, size = len, add;",
+	"\tCELL *c;",
+	"",
+	"\tn += n < 0 ? -MARGIN : MARGIN;",
+	"\tdo {",
+	"\t\tif (size > (size_t) -1 / 2 / sizeof(CELL))",
+	"\t\t\tfail(\"bad memory allocation\");",
+	"\t\tsize *= 2;",
+	"\t\tadd = size - len;",
+	"\t} while (n < 0 ? pos + add < (size_t) -n : pos + n >= size);",
+	"",
+	"\tc = (CELL *) realloc(cells, size * sizeof(CELL));",
+	"\tif (!c)",
+	"\t\tfail(\"bad memory allocation\");",
+	"",
+	"\tif (n < 0) {",
+	"\t\tmemmove(c + add, c, len * sizeof(CELL));",
+	"\t\tmemset(c, 0, add * sizeof(CELL));",
+	"\t\tpos += add;",
+	"\t} else {",
+	"\t\tmemset(c + len, 0, add * sizeof(CELL));",
+	"\t}",
+	"",
+	"\tcells = c;",
+	"\tlen = size;",
+	"\tlo = c + MARGIN;",
+	"\thi = c + size - 1 - MARGIN;",
+	"",
+	"\treturn c + pos;",
+	"}",
+	"",
+	"#define M(n) \\",
+	"\tdo { \\",
+	"\t\tif ((n) < 0 ? p - lo < -(n) : hi - p < (n)) \\",
+	"\t\t\tp = grow(p, (n)); \\",
+	"\t\tp += (n); \\",
+	"\t} while (0)",
+	"",
+	"#define O(o) \\",
+	"\tdo { \\",
+	"\t\tif (putchar((unsigned char) p[o]) == EOF) \\",
+	"\t\t\tfail(\"input/output error\"); \\",
+	"\t} while (0)",
+	"",
+	"#define W(s, n) \\",
+	"\tdo { \\",
+	"\t\tif (fwrite((s), 1, (n), stdout) != (n)) \\",
+	"\t\t\tfail(\"input/output error\"); \\",
+	"\t} while (0)",
+	"",
+	"#define I(o) \\",
+	"\tdo { \\",
+	"\t\tint c; \\",
+	"\t\tfflush(stdout); \\",
+	"\t\tif ((c = getchar()) != EOF) \\",
+	"\t\t\tp[o] = c; \\",
+	"\t\telse \\",
+	"\t\t\tI_EOF(o); \\",
+	"\t} while (0)",
+	"",
+	"int main(int argc, char *argv[])",
+	"{",
+	"\tCELL *p;",
+	"",
+	"\t(void) argc;",
+	"\tname = argv[0];",
+	"\tlen = TAPE_INIT;",
+	"\tcells = (CELL *) calloc(len, sizeof(CELL));",
+	"\tif (!cells)",
+	"\t\tfail(\"bad memory allocation\");",
+	"\tlo = cells + MARGIN;",
+	"\thi = cells + len - 1 - MARGIN;",
+	"\tp = lo;",
+	"",
+	NULL
+};
+
+static void lines(FILE *fp, const char *const *line)
+{
+	for (; *line; ++line) {
+		fputs(*line, fp);
+		putc('\n', fp);
+	}
+}
+
+/* the smallest tape that still has margin cells on both sides */
+static unsigned long tape_init(const struct program *prog)
+{
+	unsigned long len = TAPE_INIT;
+
+	while (len <= 2 * prog->margin)
+		len *= 2;
+
+	return len;
+}
+
+/* a value as a cell of the given width has it */
+static unsigned long cell_value(long n, int bits)
+{
+	return (unsigned long) n & (0xffffffffUL >> (32 - bits));
+}
+
+/*
+ * Writes out a run of SETs of the same cell that are each
+ * followed by an OUT of it, which is how precompute() leaves the
+ * output it worked out, as string literals, which compilers deal
+ * with a lot better than one putchar() per byte. The cell still
+ * ends up with the last value set, unless it's set again anyway.
+ *
+ * args: file to write to, first SET of the run, indentation,
+ *       bits in a cell
+ * returns: the last instruction of the run
+ */
+static const struct op *c_write(FILE *fp, const struct op *op, int depth,
+				int bits)
+{
+	unsigned char c;
+	int i, n = 0;
+
+	for (;;) {
+		c = (unsigned char) op->arg;
+		if (!n++)
+			fputs("W(\"", fp);
+		if (c >= ' ' && c <= '~' && c != '"' && c != '\\' && c != '?')
+			putc(c, fp);
+		else
+			fprintf(fp, "\\%03o", c);
+
+		if (op[2].kind != OP_SET || op[3].kind != OP_OUT ||
+		    op[2].off != op->off || op[3].off != op->off)
+			break;
+
+		if (n == C_WRITE_MAX) {
+			fprintf(fp, "\", %d);\n", n);
+			for (i = 0; i < depth; ++i)
+				putc('\t', fp);
+			n = 0;
+		}
+		op += 2;
+	}
+
+	fprintf(fp, "\", %d);\n", n);
+	if (op[2].kind != OP_SET || op[2].off != op->off) {
+		for (i = 0; i < depth; ++i)
+			putc('\t', fp);
+		fprintf(fp, "p[%d] = %lu;\n", op->off,
+			cell_value(op->arg, bits));
+	}
+
+	return op + 1;
+}
+
+/*
+ * Writes a program out as C.
+ *
+ * Loops become while loops, so the compiler gets to see the
+ * structure of the program instead of a pile of gotos.
+ *
+ * args: file to write to, program from optimize(), what , gives
+ *       at the end of input (0, -1 or IO_KEEP), bits in a cell
+ *       (8, 16 or 32)
+ * returns: 0 for success, 3 for I/O error
+ */
+INT_STAT emit_c(FILE *fp, const struct program *prog, int eof, int bits)
+{
+	const struct op *op;
+	int depth = 1, i;
+
+	fputs("/* Generated by bf. */\n\n", fp);
+	fprintf(fp, "#define CELL %s\n", bits == 32 ? "unsigned int"
+		: bits == 16 ? "unsigned short" : "unsigned char");
+	fprintf(fp, "#define MARGIN %luL\n", (unsigned long) prog->margin);
+	fprintf(fp, "#define TAPE_INIT %lu\n", tape_init(prog));
+	if (eof == IO_KEEP)
+		fputs("#define I_EOF(o) ((void) 0)\n\n", fp);
+	else
+		fprintf(fp, "#define I_EOF(o) (p[o] = %lu)\n\n",
+			cell_value(eof, bits));
+	lines(fp, c_head);
+
+	for (op = prog->ops; op->kind != OP_END; ++op) {
+		if (op->kind == OP_JNZ)
+			--depth;
+
+		for (i = 0; i < depth; ++i)
+			putc('\t', fp);
+
+		if (op->kind == OP_SET && op[1].kind == OP_OUT &&
+		    op[1].off == op->off) {
+			op = c_write(fp, op, depth, bits);
+			continue;
+		}
+
+		switch (op->kind) {
+		case OP_ADD:
+			fprintf(fp, "p[%d] += %lu;\n", op->off,
+				cell_value(op->arg, bits));
+			break;
+		case OP_SET:
+			fprintf(fp, "p[%d] = %lu;\n", op->off,
+				cell_value(op->arg, bits));
+			break;
+		case OP_MOVE:
+			fprintf(fp, "M(%ld);\n", op->arg);
+			break;
+		case OP_OUT:
+			fprintf(fp, "O(%d);\n", op->off);
+			break;
+		case OP_IN:
+			fprintf(fp, "I(%d);\n", op->off);
+			break;
+		case OP_JZ:
+			fputs("while (*p) {\n", fp);
+			++depth;
+			break;
+		case OP_JNZ:
+			fputs("}\n", fp);
+			break;
+		case OP_MUL:
+			fprintf(fp, "p[%d] += *p * %luUL;\n", op->off,
+				cell_value(op->arg, bits));
+			break;
+		case OP_SCAN:
+			fprintf(fp, "while (*p) M(%ld);\n", op->arg);
+			break;
+		}
+	}
+
+	fputs("\n\tfree(cells);\n\treturn 0;\n}\n", fp);
+
+	return ferror(fp) ? INT_IOERR : INT_SUCC;
+}
+
+/*
+ * The generated assembly uses the same registers as the JIT, see
+ * jit.c, and grows the tape in bf_grow(), a translation of the
+ * grow() above. Only the instructions are generated; everything
+ * else is fixed, apart from the margin and the initial size of
+ * the tape, which are assembler symbols.
+ */
+static const char *const x86_head[] = {
+	"\t.intel_syntax noprefix",
+	"\t.text",
+	"",
+	"/* rdi = pointer, rsi = distance to cover; returns the pointer */",
+	"bf_grow:",
+	"\tpush rbx",
+	"\tpush r12",
+	"\tpush r13",
+	"\tpush r14",
+	"\tpush r15",
+	"\tmov r12, rdi",
+	"\tsub r12, qword ptr [rip + bf_cells]",
+	"\tmov r13, rsi",
+	"\tmov r14, qword ptr [rip + bf_len]",
+	"\tmov r15, r14",
+	"1:\tadd r15, r15",
+	"\tjc .Lmemerr",
+	"\tmov rbx, r15",
+	"\tsub rbx, r14",
+	"\ttest r13, r13",
+	"\tjs 2f",
+	"\tlea rax, [r12 + r13]",
+	"\tcmp rax, r15",
+	"\tjae 1b",
+	"\tjmp 3f",
+	"2:\tlea rax, [r12 + rbx]",
+	"\tmov rcx, r13",
+	"\tneg rcx",
+	"\tcmp rax, rcx",
+	"\tjb 1b",
+	"3:\tmov rdi, qword ptr [rip + bf_cells]",
+	"\tmov rsi, r15",
+	"\tcall realloc@PLT",
+	"\ttest rax, rax",
+	"\tjz .Lmemerr",
+	"\tmov qword ptr [rip + bf_cells], rax",
+	"\ttest r13, r13",
+	"\tjs 4f",
+	"\tlea rdi, [rax + r14]",
+	"\txor esi, esi",
+	"\tmov rdx, rbx",
+	"\tcall memset@PLT",
+	"\tjmp 5f",
+	"4:\tlea rdi, [rax + rbx]",
+	"\tmov rsi, rax",
+	"\tmov rdx, r14",
+	"\tcall memmove@PLT",
+	"\tmov rdi, qword ptr [rip + bf_cells]",
+	"\txor esi, esi",
+	"\tmov rdx, rbx",
+	"\tcall memset@PLT",
+	"\tadd r12, rbx",
+	"5:\tmov qword ptr [rip + bf_len], r15",
+	"\tmov rax, qword ptr [rip + bf_cells]",
+	"\tadd rax, r12",
+	"\tpop r15",
+	"\tpop r14",
+	"\tpop r13",
+	"\tpop r12",
+	"\tpop rbx",
+	"\tret",
+	"",
+	"/* sets r13 and r14 to the bounds of the tape */",
+	"bf_bounds:",
+	"\tmov r13, qword ptr [rip + bf_cells]",
+	"\tmov r14, r13",
+	"\tadd r14, qword ptr [rip + bf_len]",
+	"\tadd r13, MARGIN",
+	"\tsub r14, MARGIN + 1",
+	"\tret",
+	"",
+	"\t.globl main",
+	"\t.type main, @function",
+	"main:",
+	"\tpush rbx",
+	"\tpush r12",
+	"\tpush r13",
+	"\tpush r14",
+	"\tpush r15",
+	"\tmov rax, qword ptr [rsi]",
+	"\tmov qword ptr [rip + bf_name], rax",
+	"\tmov qword ptr [rip + bf_len], TAPE_INIT",
+	"\tmov edi, TAPE_INIT",
+	"\tmov esi, 1",
+	"\tcall calloc@PLT",
+	"\ttest rax, rax",
+	"\tjz .Lmemerr",
+	"\tmov qword ptr [rip + bf_cells], rax",
+	"\tcall bf_bounds",
+	"\tmov rbx, r13",
+	"",
+	NULL
+};
+
+static const char *const x86_tail[] = {
+	".Lret:",
+	"\tpop r15",
+	"\tpop r14",
+	"\tpop r13",
+	"\tpop r12",
+	"\tpop rbx",
+	"\tret",
+	".Lmemerr:",
+	"\tlea rdx, [rip + .Lmemmsg]",
+	"\tjmp .Lfail",
+	".Lioerr:",
+	"\tlea rdx, [rip + .Liomsg]",
+	".Lfail:",
+	"\tlea rdi, [rip + .Lfmt]",
+	"\tmov rsi, qword ptr [rip + bf_name]",
+	"\txor eax, eax",
+	"\tcall printf@PLT",
+	"\tmov edi, 1",
+	"\tcall exit@PLT",
+	"",
+	"\t.section .rodata",
+	".Lfmt:\t.string \"%s: error: %s\\n\"",
+	".Lmemmsg:\t.string \"bad memory allocation\"",
+	".Liomsg:\t.string \"input/output error\"",
+	"",
+	"\t.bss",
+	"\t.align 8",
+	"bf_cells:\t.zero 8",
+	"bf_len:\t.zero 8",
+	"bf_name:\t.zero 8",
+	"",
+	"\t.section .note.GNU-stack,\"\",@progbits",
+	NULL
+};
+
+/* whether n fits in the 32-bit displacement of an x86 address */
+static int x86_disp(long n)
+{
+	return n >= -2147483647L && n <= 2147483647L;
+}
+
+static void x86_move(FILE *fp, long n, size_t i, long margin)
+{
+	if (x86_disp(n))
+		fprintf(fp, "\tlea rax, [rbx + %ld]\n", n);
+	else
+		fprintf(fp, "\tmov rax, %ld\n\tadd rax, rbx\n", n);
+
+	fprintf(fp, "\tcmp rax, %s\n", n < 0 ? "r13" : "r14");
+	fprintf(fp, "\t%s .Lm%lu\n", n < 0 ? "jae" : "jbe",
+		(unsigned long) i);
+	fprintf(fp, "\tmov rdi, rbx\n\tmov rsi, %ld\n\tcall bf_grow\n",
+		n < 0 ? n - margin : n + margin);
+	fputs("\tmov rbx, rax\n\tcall bf_bounds\n", fp);
+
+	if (x86_disp(n))
+		fprintf(fp, "\tlea rax, [rbx + %ld]\n", n);
+	else
+		fprintf(fp, "\tmov rax, %ld\n\tadd rax, rbx\n", n);
+
+	fprintf(fp, ".Lm%lu:\n\tmov rbx, rax\n", (unsigned long) i);
+}
+
+static void x86_op(FILE *fp, const struct program *prog, size_t i,
+		   int eof)
+{
+	const struct op *op = &prog->ops[i];
+	unsigned long j = (unsigned long) op->arg, k = (unsigned long) i;
+
+	switch (op->kind) {
+	case OP_ADD:
+		fprintf(fp, "\tadd byte ptr [rbx + %d], %d\n", op->off,
+			(unsigned char) op->arg);
+		break;
+	case OP_SET:
+		fprintf(fp, "\tmov byte ptr [rbx + %d], %d\n", op->off,
+			(unsigned char) op->arg);
+		break;
+	case OP_MOVE:
+		x86_move(fp, op->arg, i, (long) prog->margin);
+		break;
+	case OP_OUT:
+		fprintf(fp, "\tmovzx edi, byte ptr [rbx + %d]\n"
+			"\tcall putchar@PLT\n\tcmp eax, -1\n\tje .Lioerr\n",
+			op->off);
+		break;
+	case OP_IN:
+		fputs("\txor edi, edi\n\tcall fflush@PLT\n"
+		      "\tcall getchar@PLT\n", fp);
+		if (eof == IO_KEEP)
+			fputs("\tcmp eax, -1\n\tje 1f\n", fp);
+		else if (eof != -1)
+			fprintf(fp, "\tcmp eax, -1\n\tjne 1f\n\tmov eax, %d\n1:\n",
+				(unsigned char) eof);
+		fprintf(fp, "\tmov byte ptr [rbx + %d], al\n", op->off);
+		if (eof == IO_KEEP)
+			fputs("1:\n", fp);
+		break;
+	case OP_JZ:
+		fprintf(fp, "\tcmp byte ptr [rbx], 0\n\tje .Le%lu\n.Lb%lu:\n",
+			k, k);
+		break;
+	case OP_JNZ:
+		fprintf(fp, "\tcmp byte ptr [rbx], 0\n\tjne .Lb%lu\n.Le%lu:\n",
+			j, j);
+		break;
+	case OP_MUL:
+		fprintf(fp, "\tmovzx eax, byte ptr [rbx]\n"
+			"\timul eax, eax, %d\n"
+			"\tadd byte ptr [rbx + %d], al\n",
+			(unsigned char) op->arg, op->off);
+		break;
+	case OP_SCAN:
+		fprintf(fp, ".Ls%lu:\n\tcmp byte ptr [rbx], 0\n\tje .Lt%lu\n",
+			k, k);
+		x86_move(fp, op->arg, i, (long) prog->margin);
+		fprintf(fp, "\tjmp .Ls%lu\n.Lt%lu:\n", k, k);
+		break;
+	case OP_END:
+		fputs("\txor eax, eax\n\tjmp .Lret\n", fp);
+		break;
+	}
+}
+
+static const char *const a64_head[] = {
+	"\t.text",
+	"",
+	"/* x0 = pointer, x1 = distance to cover; returns the pointer */",
+	"bf_grow:",
+	"\tstp x29, x30, [sp, -64]!",
+	"\tmov x29, sp",
+	"\tstp x19, x20, [sp, 16]",
+	"\tstp x21, x22, [sp, 32]",
+	"\tstp x23, x24, [sp, 48]",
+	"\tadrp x9, bf_cells",
+	"\tldr x9, [x9, :lo12:bf_cells]",
+	"\tsub x19, x0, x9",
+	"\tmov x20, x1",
+	"\tadrp x9, bf_len",
+	"\tldr x21, [x9, :lo12:bf_len]",
+	"\tmov x22, x21",
+	"1:\tadds x22, x22, x22",
+	"\tb.cs .Lmemerr",
+	"\tsub x23, x22, x21",
+	"\ttbnz x20, 63, 2f",
+	"\tadd x9, x19, x20",
+	"\tcmp x9, x22",
+	"\tb.hs 1b",
+	"\tb 3f",
+	"2:\tadd x9, x19, x23",
+	"\tneg x10, x20",
+	"\tcmp x9, x10",
+	"\tb.lo 1b",
+	"3:\tadrp x9, bf_cells",
+	"\tldr x0, [x9, :lo12:bf_cells]",
+	"\tmov x1, x22",
+	"\tbl realloc",
+	"\tcbz x0, .Lmemerr",
+	"\tmov x24, x0",
+	"\tadrp x9, bf_cells",
+	"\tstr x0, [x9, :lo12:bf_cells]",
+	"\ttbnz x20, 63, 4f",
+	"\tadd x0, x24, x21",
+	"\tmov w1, 0",
+	"\tmov x2, x23",
+	"\tbl memset",
+	"\tb 5f",
+	"4:\tadd x0, x24, x23",
+	"\tmov x1, x24",
+	"\tmov x2, x21",
+	"\tbl memmove",
+	"\tmov x0, x24",
+	"\tmov w1, 0",
+	"\tmov x2, x23",
+	"\tbl memset",
+	"\tadd x19, x19, x23",
+	"5:\tadrp x9, bf_len",
+	"\tstr x22, [x9, :lo12:bf_len]",
+	"\tadd x0, x24, x19",
+	"\tldp x23, x24, [sp, 48]",
+	"\tldp x21, x22, [sp, 32]",
+	"\tldp x19, x20, [sp, 16]",
+	"\tldp x29, x30, [sp], 64",
+	"\tret",
+	"",
+	"/* sets x21 and x22 to the bounds of the tape */",
+	"bf_bounds:",
+	"\tadrp x9, bf_cells",
+	"\tldr x21, [x9, :lo12:bf_cells]",
+	"\tadrp x9, bf_len",
+	"\tldr x22, [x9, :lo12:bf_len]",
+	"\tadd x22, x21, x22",
+	"\tldr x9, =MARGIN",
+	"\tadd x21, x21, x9",
+	"\tsub x22, x22, x9",
+	"\tsub x22, x22, 1",
+	"\tret",
+	"\t.ltorg",
+	"",
+	"\t.globl main",
+	"\t.type main, %function",
+	"main:",
+	"\tstp x29, x30, [sp, -48]!",
+	"\tmov x29, sp",
+	"\tstp x19, x20, [sp, 16]",
+	"\tstp x21, x22, [sp, 32]",
+	"\tldr x9, [x1]",
+	"\tadrp x10, bf_name",
+	"\tstr x9, [x10, :lo12:bf_name]",
+	"\tldr x0, =TAPE_INIT",
+	"\tadrp x10, bf_len",
+	"\tstr x0, [x10, :lo12:bf_len]",
+	"\tmov x1, 1",
+	"\tbl calloc",
+	"\tcbnz x0, 1f",
+	"\tb .Lmemerr",
+	"1:\tadrp x10, bf_cells",
+	"\tstr x0, [x10, :lo12:bf_cells]",
+	"\tbl bf_bounds",
+	"\tmov x19, x21",
+	"\tb .Lstart",
+	"\t.ltorg",
+	".Lstart:",
+	"",
+	NULL
+};
+
+static const char *const a64_tail[] = {
+	".Lret:",
+	"\tldp x21, x22, [sp, 32]",
+	"\tldp x19, x20, [sp, 16]",
+	"\tldp x29, x30, [sp], 48",
+	"\tret",
+	".Lmemerr:",
+	"\tadrp x2, .Lmemmsg",
+	"\tadd x2, x2, :lo12:.Lmemmsg",
+	"\tb .Lfail",
+	".Lioerr:",
+	"\tadrp x2, .Liomsg",
+	"\tadd x2, x2, :lo12:.Liomsg",
+	".Lfail:",
+	"\tadrp x0, .Lfmt",
+	"\tadd x0, x0, :lo12:.Lfmt",
+	"\tadrp x1, bf_name",
+	"\tldr x1, [x1, :lo12:bf_name]",
+	"\tbl printf",
+	"\tmov w0, 1",
+	"\tbl exit",
+	"",
+	"\t.section .rodata",
+	".Lfmt:\t.string \"%s: error: %s\\n\"",
+	".Lmemmsg:\t.string \"bad memory allocation\"",
+	".Liomsg:\t.string \"input/output error\"",
+	"",
+	"\t.bss",
+	"\t.align 3",
+	"bf_cells:\t.zero 8",
+	"bf_len:\t.zero 8",
+	"bf_name:\t.zero 8",
+	"",
+	"\t.section .note.GNU-stack,\"\",%progbits",
+	NULL
+};
+
+/* loads any 64-bit constant into register x<reg> */
+static void a64_imm(FILE *fp, int reg, long v)
+{
+	unsigned long u = (unsigned long) v;
+	int hw;
+
+	fprintf(fp, "\tmovz x%d, %lu\n", reg, u & 0xffff);
+	for (hw = 1; hw < 4; ++hw)
+		if ((u >> (16 * hw)) & 0xffff)
+			fprintf(fp, "\tmovk x%d, %lu, lsl %d\n", reg,
+				(u >> (16 * hw)) & 0xffff, 16 * hw);
+}
+
+/* returns the register that holds the address of cell off */
+static const char *a64_cell(FILE *fp, int off)
+{
+	if (!off)
+		return "x19";
+
+	a64_imm(fp, 9, off);
+	fputs("\tadd x9, x19, x9\n", fp);
+
+	return "x9";
+}
+
+static void a64_move(FILE *fp, long n, size_t i, long margin)
+{
+	a64_imm(fp, 9, n);
+	fprintf(fp, "\tadd x9, x19, x9\n\tcmp x9, %s\n\t%s .Lm%lu\n",
+		n < 0 ? "x21" : "x22", n < 0 ? "b.hs" : "b.ls",
+		(unsigned long) i);
+	fputs("\tmov x0, x19\n", fp);
+	a64_imm(fp, 1, n < 0 ? n - margin : n + margin);
+	fputs("\tbl bf_grow\n\tmov x19, x0\n\tbl bf_bounds\n", fp);
+	a64_imm(fp, 9, n);
+	fprintf(fp, "\tadd x9, x19, x9\n.Lm%lu:\n\tmov x19, x9\n",
+		(unsigned long) i);
+}
+
+static void a64_op(FILE *fp, const struct program *prog, size_t i,
+		   int eof)
+{
+	const struct op *op = &prog->ops[i];
+	unsigned long j = (unsigned long) op->arg, k = (unsigned long) i;
+	const char *r;
+
+	switch (op->kind) {
+	case OP_ADD:
+		r = a64_cell(fp, op->off);
+		fprintf(fp, "\tldrb w10, [%s]\n\tadd w10, w10, %d\n"
+			"\tstrb w10, [%s]\n", r, (unsigned char) op->arg, r);
+		break;
+	case OP_SET:
+		r = a64_cell(fp, op->off);
+		fprintf(fp, "\tmov w10, %d\n\tstrb w10, [%s]\n",
+			(unsigned char) op->arg, r);
+		break;
+	case OP_MOVE:
+		a64_move(fp, op->arg, i, (long) prog->margin);
+		break;
+	case OP_OUT:
+		r = a64_cell(fp, op->off);
+		fprintf(fp, "\tldrb w0, [%s]\n\tbl putchar\n\tcmn w0, 1\n"
+			"\tb.ne 1f\n\tb .Lioerr\n1:\n", r);
+		break;
+	case OP_IN:
+		fputs("\tmov x0, 0\n\tbl fflush\n\tbl getchar\n", fp);
+		if (eof == IO_KEEP)
+			fputs("\tcmn w0, 1\n\tb.eq 1f\n", fp);
+		else if (eof != -1)
+			fprintf(fp, "\tmov w10, %d\n\tcmn w0, 1\n"
+				"\tcsel w0, w10, w0, eq\n", (unsigned char) eof);
+		fprintf(fp, "\tstrb w0, [%s]\n", a64_cell(fp, op->off));
+		if (eof == IO_KEEP)
+			fputs("1:\n", fp);
+		break;
+	case OP_JZ:
+		fprintf(fp, "\tldrb w10, [x19]\n\tcbnz w10, .Lb%lu\n"
+			"\tb .Le%lu\n.Lb%lu:\n", k, k, k);
+		break;
+	case OP_JNZ:
+		fprintf(fp, "\tldrb w10, [x19]\n\tcbz w10, .Le%lu\n"
+			"\tb .Lb%lu\n.Le%lu:\n", j, j, j);
+		break;
+	case OP_MUL:
+		fprintf(fp, "\tldrb w10, [x19]\n\tmov w11, %d\n"
+			"\tmul w10, w10, w11\n", (unsigned char) op->arg);
+		r = a64_cell(fp, op->off);
+		fprintf(fp, "\tldrb w12, [%s]\n\tadd w12, w12, w10\n"
+			"\tstrb w12, [%s]\n", r, r);
+		break;
+	case OP_SCAN:
+		fprintf(fp, ".Ls%lu:\n\tldrb w10, [x19]\n\tcbnz w10, 1f\n"
+			"\tb .Lt%lu\n1:\n", k, k);
+		a64_move(fp, op->arg, i, (long) prog->margin);
+		fprintf(fp, "\tb .Ls%lu\n.Lt%lu:\n", k, k);
+		break;
+	case OP_END:
+		fputs("\tmov w0, 0\n\tb .Lret\n", fp);
+		break;
+	}
+}
+
+static INT_STAT asm_file(FILE *fp, const struct program *prog, int eof,
+			 const char *const *head,
+			 void (*op)(FILE *, const struct program *, size_t, int),
+			 const char *const *tail)
+{
+	size_t i;
+
+	fputs("/* Generated by bf. */\n\n", fp);
+	fprintf(fp, "\t.set MARGIN, %lu\n", (unsigned long) prog->margin);
+	fprintf(fp, "\t.set TAPE_INIT, %lu\n\n", tape_init(prog));
+	lines(fp, head);
+
+	for (i = 0; i < prog->len; ++i)
+		op(fp, prog, i, eof);
+
+	fputc('\n', fp);
+	lines(fp, tail);
+
+	return ferror(fp) ? INT_IOERR : INT_SUCC;
+}
+
+/*
+ * Writes a program out as assembly for the machine bf is running
+ * on, which has to be x86-64 or AArch64 with an ELF toolchain.
+ *
+ * args: file to write to, program from optimize(), what , gives
+ *       at the end of input (0, -1 or IO_KEEP)
+ * returns: 0 for success, 1 if this machine isn't supported,
+ *          3 for I/O error
+ */
+INT_STAT emit_asm(FILE *fp, const struct program *prog, int eof)
+{
+#if defined(__x86_64__) && defined(__ELF__)
+	(void) a64_head;
+	(void) a64_op;
+	(void) a64_tail;
+	return asm_file(fp, prog, eof, x86_head, x86_op, x86_tail);
+#elif defined(__aarch64__) && defined(__ELF__)
+	(void) x86_head;
+	(void) x86_op;
+	(void) x86_tail;
+	return asm_file(fp, prog, eof, a64_head, a64_op, a64_tail);
+#else
+	(void) asm_file;
+	(void) x86_head;
+	(void) x86_op;
+	(void) x86_tail;
+	(void) a64_head;
+	(void) a64_op;
+	(void) a64_tail;
+	(void) fp;
+	(void) prog;
+	(void) eof;
+	return INT_INVL;
+#endif
+}
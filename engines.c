@@ -0,0 +1,51 @@
+/*
+ * The interpreters, built once for each cell width from
+ * engines.h so that none of them has to work out how wide a cell
+ * is while it runs.
+ */
+
+#include <limits.h>
+#include <stdlib.h>
+
+#include "bfint.h"
+
+#define CELL unsigned char
+#define NAME(name) name##_8
+#define ENGINES engines_8
+#include "engines.h"
+#undef CELL
+#undef NAME
+#undef ENGINES
+
+#if USHRT_MAX == 0xffff
+#define CELL unsigned short
+#else
+#error "no 16-bit type for cells"
+#endif
+#define NAME(name) name##_16
+#define ENGINES engines_16
+#include "engines.h"
+#undef CELL
+#undef NAME
+#undef ENGINES
+
+#if UINT_MAX == 0xffffffff
+#define CELL unsigned int
+#elif ULONG_MAX == 0xffffffff
+#define CELL unsigned long
+#else
+#error "no 32-bit type for cells"
+#endif
+#define NAME(name) name##_32
+#define ENGINES engines_32
+#include "engines.h"
+#undef CELL
+#undef NAME
+#undef ENGINES
+
+/* returns: the interpreters for cells of bits bits */
+const struct engines *engines_for(int bits)
+{
+	return bits == 32 ? &engines_32 : bits == 16 ? &engines_16
+			  : &engines_8;
+}
@@ -0,0 +1,111 @@
+/*
+ * The interpreters for one cell width, see interp.h. Before
+ * including this, define CELL as the type of a cell, NAME(name)
+ * to append something to name that's different for each width,
+ * and ENGINES as the name of the struct engines to put them in.
+ *
+ * There's one interpreter for each way of dispatching, one of
+ * each that counts for --stats and one of each for guarded
+ * tapes. Without computed goto the threaded interpreters are
+ * the switch ones.
+ */
+
+#define INTERP NAME(interpret_switch)
+#define THREADED 0
+#define STATS 0
+#define PROFILE 0
+#define GUARDED 0
+#include "interp.h"
+#undef INTERP
+#undef THREADED
+#undef STATS
+#undef PROFILE
+#undef GUARDED
+
+#define INTERP NAME(interpret_switch_stats)
+#define THREADED 0
+#define STATS 1
+#define PROFILE 0
+#define GUARDED 0
+#include "interp.h"
+#undef INTERP
+#undef THREADED
+#undef STATS
+#undef PROFILE
+#undef GUARDED
+
+#define INTERP NAME(interpret_switch_guarded)
+#define THREADED 0
+#define STATS 0
+#define PROFILE 0
+#define GUARDED 1
+#include "interp.h"
+#undef INTERP
+#undef THREADED
+#undef STATS
+#undef PROFILE
+#undef GUARDED
+
+#ifdef __GNUC__
+#define INTERP NAME(interpret_threaded)
+#define THREADED 1
+#define STATS 0
+#define PROFILE 0
+#define GUARDED 0
+#include "interp.h"
+#undef INTERP
+#undef THREADED
+#undef STATS
+#undef PROFILE
+#undef GUARDED
+
+#define INTERP NAME(interpret_threaded_stats)
+#define THREADED 1
+#define STATS 1
+#define PROFILE 0
+#define GUARDED 0
+#include "interp.h"
+#undef INTERP
+#undef THREADED
+#undef STATS
+#undef PROFILE
+#undef GUARDED
+
+#define INTERP NAME(interpret_threaded_guarded)
+#define THREADED 1
+#define STATS 0
+#define PROFILE 0
+#define GUARDED 1
+#include "interp.h"
+#undef INTERP
+#undef THREADED
+#undef STATS
+#undef PROFILE
+#undef GUARDED
+#endif
+
+/* profiling is slow anyway, so it might as well be portable */
+#define INTERP NAME(interpret_profile)
+#define THREADED 0
+#define STATS 1
+#define PROFILE 1
+#define GUARDED 0
+#include "interp.h"
+#undef INTERP
+#undef THREADED
+#undef STATS
+#undef PROFILE
+#undef GUARDED
+
+static const struct engines ENGINES = {
+#ifdef __GNUC__
+	{ NAME(interpret_switch), NAME(interpret_threaded) },
+	{ NAME(interpret_switch_stats), NAME(interpret_threaded_stats) },
+	{ NAME(interpret_switch_guarded), NAME(interpret_threaded_guarded) },
+#else
+	{ NAME(interpret_switch), NAME(interpret_switch) },
+	{ NAME(interpret_switch_stats), NAME(interpret_switch_stats) },
+	{ NAME(interpret_switch_guarded), NAME(interpret_switch_guarded) },
+#endif
+	NAME(interpret_profile)
+};
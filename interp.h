@@ -0,0 +1,241 @@
+/*
+ * The interpreter, written once and included by engines.h for each
+ * way of dispatching instructions. Before including this, define
+ * INTERP as the name of the function to generate, THREADED as 1
+ * for computed goto or 0 for a switch, STATS as 1 to count for
+ * --stats and PROFILE as 1 to count for --profile too, or as 0
+ * not to. Interpreters that count keep the numbers in locals
+ * and only write them out to the struct stats when they return.
+ * GUARDED is 1 for an interpreter that never checks its moves,
+ * which tape_run() runs on a guarded tape, or 0 for one that
+ * grows the tape itself. CELL is the unsigned type of a cell,
+ * which wraps around at its own width.
+ *
+ * The switch is plain ANSI C, but every instruction goes back
+ * through the same indirect branch at the top of the loop, which
+ * the branch predictor can't do much with. With computed goto,
+ * each handler ends in its own jump to the next one, so each
+ * jump gets its own prediction, and the bounds check the switch
+ * does goes away too. That needs GCC or something compatible;
+ * __extension__ keeps -pedantic-errors quiet about it.
+ *
+ * Handlers start with CASE() and end with NEXT, which moves on
+ * to the instruction after pc. OP_JZ and OP_JNZ land on their
+ * matching bracket, so NEXT steps past it.
+ */
+
+#if THREADED
+#define CASE(kind) L_##kind:
+#define NEXT __extension__ ({ ++pc; COUNT; goto *labels[pc->kind]; })
+#else
+#define CASE(kind) case kind:
+#define NEXT break
+#endif
+
+#if STATS
+#define STEP (++steps)
+#define TRACK(n) \
+	do { \
+		at += (n); \
+		if (at < low) \
+			low = at; \
+		if (at > high) \
+			high = at; \
+	} while (0)
+#define DONE(status) \
+	do { \
+		stats->steps = steps; \
+		stats->lo = low; \
+		stats->hi = high; \
+		return (status); \
+	} while (0)
+#else
+#define STEP ((void) 0)
+#define TRACK(n) ((void) 0)
+#define DONE(status) return (status)
+#endif
+
+#if PROFILE
+#define COUNT (STEP, ++counts[pc - prog->ops])
+#else
+#define COUNT STEP
+#endif
+
+/*
+ * Runs a compiled program.
+ *
+ * args: tape to run on, program from compile(), I/O state,
+ *       limits on the run or NULL, what to count in, if anything
+ * returns: 0 for success, 2 for bad memory allocation,
+ *          3 for I/O error, 5 if a limit was reached
+ */
+static INT_STAT INTERP(struct tape *tape, const struct program *prog,
+		       struct io *io, struct limit *limit,
+		       struct stats *stats)
+{
+	CELL *ptr = (CELL *) (tape->cells + tape->origin);
+#if !GUARDED
+	long margin = (long) prog->margin;
+	CELL *lo, *hi;
+#endif
+	const struct op *pc;
+	long n, left = limit_start(limit);
+	int c;
+#if STATS
+	double steps = 0;
+	long at = 0, low = 0, high = 0;
+#endif
+#if PROFILE
+	double *counts = stats->counts;
+#endif
+#if THREADED
+	/* in the same order as the enum in bfint.h */
+	static const void *const labels[] = {
+		__extension__ &&L_OP_ADD,
+		__extension__ &&L_OP_MOVE,
+		__extension__ &&L_OP_OUT,
+		__extension__ &&L_OP_IN,
+		__extension__ &&L_OP_JZ,
+		__extension__ &&L_OP_JNZ,
+		__extension__ &&L_OP_SET,
+		__extension__ &&L_OP_MUL,
+		__extension__ &&L_OP_SCAN,
+		__extension__ &&L_OP_END
+	};
+#endif
+
+	/*
+	 * lo and hi are the furthest the pointer can go to either
+	 * side while keeping margin cells of tape around it, so
+	 * that OP_MUL never has to check for the end of the tape.
+	 * On a guarded tape, running off the end faults instead.
+	 */
+
+#if GUARDED
+#define MOVE(n) \
+	do { \
+		ptr += (n); \
+		TRACK(n); \
+	} while (0)
+#else
+#define MOVE(n) \
+	do { \
+		if ((n) < 0 ? ptr - lo < -(n) : hi - ptr < (n)) { \
+			ptr = (CELL *) tape_grow(tape, \
+				(unsigned char *) ptr, \
+				(n) < 0 ? (n) - margin : (n) + margin); \
+			if (!ptr) \
+				DONE(INT_MEMERR); \
+			lo = (CELL *) tape->cells + margin; \
+			hi = (CELL *) (tape->cells + tape->len) - 1 - margin; \
+		} \
+		ptr += (n); \
+		TRACK(n); \
+	} while (0)
+#endif
+
+	/*
+	 * How far away the next zero cell n cells at a time is, see
+	 * scan.c. If it isn't on the tape, the cell the scan would
+	 * step on past the end is new, and so is zero.
+	 */
+
+#define SCAN(n) ((n) > 0 \
+	? (long) (scan_right((unsigned char *) ptr, \
+		tape->cells + tape->len - (unsigned char *) ptr, \
+		(n) * sizeof(CELL), sizeof(CELL)) / sizeof(CELL)) \
+	: -(long) (scan_left((unsigned char *) ptr, \
+		(unsigned char *) (ptr + 1) - tape->cells, \
+		-(n) * sizeof(CELL), sizeof(CELL)) / sizeof(CELL)))
+
+#if !STATS
+	(void) stats;
+#endif
+
+#if !GUARDED
+	ptr = (CELL *) tape_reserve(tape, (unsigned char *) ptr, margin);
+	if (!ptr)
+		DONE(INT_MEMERR);
+
+	lo = (CELL *) tape->cells + margin;
+	hi = (CELL *) (tape->cells + tape->len) - 1 - margin;
+#endif
+
+	/* a run carried on from a checkpoint starts in the middle */
+	pc = prog->ops + (limit ? limit->pc : 0);
+
+#if THREADED
+	COUNT;
+	__extension__ ({ goto *labels[pc->kind]; });
+	{
+#else
+	for (; ; ++pc) {
+		COUNT;
+		switch (pc->kind) {
+#endif
+		CASE(OP_ADD)
+			ptr[pc->off] += (CELL) pc->arg;
+			NEXT;
+		CASE(OP_MOVE)
+			MOVE(pc->arg);
+			NEXT;
+		CASE(OP_OUT)
+			if (IO_PUT(io, (unsigned char) ptr[pc->off]))
+				DONE(INT_IOERR);
+			NEXT;
+		CASE(OP_IN)
+			c = IO_GET(io);
+			if (c == IO_ERR)
+				DONE(INT_IOERR);
+			if (c != IO_KEEP)
+				ptr[pc->off] = (CELL) c;
+			NEXT;
+		CASE(OP_JZ)
+			if (!*ptr)
+				pc = prog->ops + pc->arg;
+			NEXT;
+		CASE(OP_JNZ)
+			/* going round again costs its length, see limit.c */
+			if (*ptr) {
+				n = pc - (prog->ops + pc->arg);
+				pc -= n;
+				if ((left -= n) < 0 &&
+				    (left = limit_more(limit, left,
+						pc + 1 - prog->ops,
+						(unsigned char *) ptr)) <= 0)
+					DONE(INT_LIMIT);
+			}
+			NEXT;
+		CASE(OP_SET)
+			ptr[pc->off] = (CELL) pc->arg;
+			NEXT;
+		CASE(OP_MUL)
+			ptr[pc->off] += (CELL) ((unsigned long) *ptr *
+					       (unsigned long) pc->arg);
+			NEXT;
+		CASE(OP_SCAN)
+			if (*ptr && pc->arg <= SCAN_MAX / (long) sizeof(CELL) &&
+			    pc->arg >= -SCAN_MAX / (long) sizeof(CELL)) {
+				n = SCAN(pc->arg);
+				MOVE(n);
+			}
+			while (*ptr)
+				MOVE(pc->arg);
+			NEXT;
+		CASE(OP_END)
+			DONE(INT_SUCC);
+#if !THREADED
+		}
+#endif
+	}
+
+#undef MOVE
+#undef SCAN
+}
+
+#undef CASE
+#undef NEXT
+#undef STEP
+#undef TRACK
+#undef DONE
+#undef COUNT
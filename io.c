@@ -0,0 +1,407 @@
+/*
+ * Input and output for the , and . commands.
+ *
+ * Output is collected in a buffer and written out with a single
+ * fwrite() whenever the buffer fills up, before every read and
+ * when the program ends. Writing every byte on its own costs a
+ * system call per byte, which is where programs that print a
+ * lot used to spend most of their time.
+ *
+ * In unbuffered mode there is no buffer at all, so every byte
+ * goes straight to the unbuffered stdout, like it did before.
+ * That's the default when stdout is a terminal.
+ *
+ * Input is read ahead in chunks the same way, with read() on
+ * the input descriptor so a terminal or pipe hands over what it
+ * has right away instead of blocking until the chunk is full.
+ * IO_GET() serves , from the chunk and only calls io_get() to
+ * read the next one. Without POSIX there's no such call, so the
+ * chunks are a single getchar() long.
+ *
+ * All of that goes through io->read and io->write, which are the
+ * stdio ones here, so the library can swap in its own.
+ *
+ * The source file is read here too, one piece at a time, so it
+ * never has to be in memory all at once. Regular files are
+ * mapped a window at a time instead of being copied, which
+ * matters for generated programs hundreds of megabytes long.
+ * Anything that can't be mapped, like a pipe, is read in chunks
+ * into a buffer.
+ */
+
+#if defined(__unix__) || defined(__APPLE__)
+#define _POSIX_C_SOURCE 200809L
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "bfint.h"
+
+/* io->read for stdin */
+static long std_read(void *user, unsigned char *buf, size_t len)
+{
+#ifdef _POSIX_VERSION
+	ssize_t n;
+
+	(void) user;
+
+	do
+		n = read(STDIN_FILENO, buf, len);
+	while (n < 0 && errno == EINTR);
+
+	return (long) n;
+#else
+	int c;
+
+	(void) user;
+	(void) len;
+
+	if ((c = getchar()) == EOF)
+		return 0;
+	buf[0] = (unsigned char) c;
+
+	return 1;
+#endif
+}
+
+/* io->write for stdout */
+static int std_write(void *user, const unsigned char *buf, size_t len)
+{
+	(void) user;
+
+	return fwrite(buf, 1, len, stdout) != len;
+}
+
+/*
+ * Sets up the buffers, reading from stdin and writing to stdout.
+ *
+ * args: I/O state to set up, nonzero to buffer output, what ,
+ *       gives at the end of input (0, -1 or IO_KEEP)
+ * returns: 0 for success, 2 for bad memory allocation
+ */
+INT_STAT io_init(struct io *io, int buffered, int eof)
+{
+	io->read = std_read;
+	io->write = std_write;
+	io->user = NULL;
+	io->out = NULL;
+	io->outlen = 0;
+	io->outcap = 0;
+	io->inpos = 0;
+	io->inlen = 0;
+	io->eof = eof;
+	io->nin = 0;
+	io->nout = 0;
+	io->time = 0;
+	io->timed = 0;
+
+	io->in = (unsigned char *) malloc(IO_BUFSIZE);
+	if (!io->in)
+		return INT_MEMERR;
+
+	if (buffered) {
+		io->out = (unsigned char *) malloc(IO_BUFSIZE);
+		if (!io->out)
+			return INT_MEMERR;
+		io->outcap = IO_BUFSIZE;
+	}
+
+	return INT_SUCC;
+}
+
+void io_free(struct io *io)
+{
+	free(io->out);
+	free(io->in);
+}
+
+/*
+ * Writes out everything in the output buffer.
+ *
+ * returns: 0 for success, nonzero for I/O error
+ */
+int io_flush(struct io *io)
+{
+	size_t len = io->outlen;
+	double start;
+	int err;
+
+	io->outlen = 0;
+	if (!len)
+		return 0;
+
+	io->nout += len;
+	if (!io->timed)
+		return io->write(io->user, io->out, len);
+
+	start = io_time();
+	err = io->write(io->user, io->out, len);
+	io->time += io_time() - start;
+
+	return err;
+}
+
+/*
+ * The slow path of IO_PUT(), for when the buffer is full or
+ * there is no buffer.
+ *
+ * returns: 0 for success, nonzero for I/O error
+ */
+int io_put(struct io *io, int c)
+{
+	unsigned char byte = (unsigned char) c;
+	double start;
+	int err;
+
+	if (!io->outcap) {
+		++io->nout;
+		if (!io->timed)
+			return io->write(io->user, &byte, 1);
+
+		start = io_time();
+		err = io->write(io->user, &byte, 1);
+		io->time += io_time() - start;
+		return err;
+	}
+
+	if (io_flush(io))
+		return 1;
+
+	io->out[io->outlen++] = byte;
+
+	return 0;
+}
+
+/*
+ * The slow path of IO_GET(), which reads the next chunk of
+ * input. Whatever has been written so far is flushed first,
+ * since the program may be waiting for an answer to it. A read
+ * error counts as the end of input, like it does for getchar().
+ *
+ * returns: the first byte of the chunk, io->eof at the end of
+ *          input, IO_ERR if the flush failed
+ */
+int io_get(struct io *io)
+{
+	double start = 0;
+	long n;
+
+	if (io->outlen && io_flush(io))
+		return IO_ERR;
+
+	io->inpos = 0;
+	io->inlen = 0;
+
+	if (io->timed)
+		start = io_time();
+
+	n = io->read(io->user, io->in, IO_BUFSIZE);
+	if (n > 0)
+		io->inlen = (size_t) n;
+
+	if (io->timed)
+		io->time += io_time() - start;
+
+	if (!io->inlen)
+		return io->eof;
+	io->nin += io->inlen;
+
+	return io->in[io->inpos++];
+}
+
+/*
+ * Bytes the program actually read, which leaves out whatever was
+ * read ahead but never used.
+ */
+double io_read(const struct io *io)
+{
+	return io->nin - (double) (io->inlen - io->inpos);
+}
+
+/*
+ * Reads past input that a run being resumed from a checkpoint had
+ * already read, keeping whatever comes after it for the program.
+ *
+ * args: I/O state nothing has been read from yet, bytes to skip
+ * returns: 0 for success, nonzero if the input ran out first
+ */
+int io_skip(struct io *io, double n)
+{
+	long got;
+
+	while (n > 0) {
+		got = io->read(io->user, io->in, IO_BUFSIZE);
+		if (got <= 0)
+			return 1;
+		io->nin += got;
+		if ((double) got > n) {
+			io->inpos = (size_t) n;
+			io->inlen = (size_t) got;
+			return 0;
+		}
+		n -= got;
+	}
+
+	return 0;
+}
+
+/*
+ * Returns the time in seconds since some fixed point, for timing
+ * things. Without POSIX there's only clock(), which counts CPU
+ * time and so leaves out time spent waiting.
+ */
+double io_time(void)
+{
+#ifdef _POSIX_VERSION
+	struct timespec ts;
+
+	if (!clock_gettime(CLOCK_MONOTONIC, &ts))
+		return ts.tv_sec + ts.tv_nsec / 1e9;
+#endif
+	return (double) clock() / CLOCKS_PER_SEC;
+}
+
+/*
+ * Works out whether output should be buffered by default, which
+ * is whenever stdout isn't a terminal. Without POSIX there's no
+ * way to tell, so output stays unbuffered just in case.
+ */
+int io_buffered(void)
+{
+#ifdef _POSIX_VERSION
+	return !isatty(STDOUT_FILENO);
+#else
+	return 0;
+#endif
+}
+
+/*
+ * Starts reading a source file, which is then handed out a piece
+ * at a time by source_next().
+ *
+ * args: source to set up, open file to read it from
+ * returns: 0 for success, 2 for bad memory allocation
+ */
+INT_STAT source_open(struct source *src, FILE *fp)
+{
+#ifdef _POSIX_VERSION
+	struct stat st;
+#endif
+
+	src->fp = fp;
+	src->str = NULL;
+	src->len = 0;
+	src->pos = 0;
+	src->size = 0;
+	src->mapped = 0;
+
+#ifdef _POSIX_VERSION
+	/* some files in /proc say they're empty, so those are read */
+	if (!fstat(fileno(fp), &st) && S_ISREG(st.st_mode) &&
+	    st.st_size > 0 && (unsigned long) st.st_size <= SIZE_MAX) {
+		src->size = st.st_size;
+		src->mapped = 1;
+		return INT_SUCC;
+	}
+#endif
+
+	src->str = (char *) malloc(IO_BUFSIZE);
+	if (!src->str)
+		return INT_MEMERR;
+
+	return INT_SUCC;
+}
+
+/*
+ * Starts reading a source that's already in memory. It's never
+ * written to, and has to stay there until the source is closed.
+ *
+ * args: source to set up, the source, its size
+ */
+void source_string(struct source *src, const char *str, size_t len)
+{
+	src->fp = NULL;
+	src->str = (char *) str;
+	src->len = 0;
+	src->pos = 0;
+	src->size = len;
+	src->mapped = 0;
+}
+
+/*
+ * Moves on to the next piece of the source, which is left in
+ * src->str and src->len. That's a window of SOURCE_WINDOW bytes
+ * mapped from the file if it can be mapped, and whatever one
+ * fread() into a buffer gets otherwise. The previous piece is
+ * gone, so no more than one piece is in memory at a time. A
+ * string is just the whole thing.
+ *
+ * returns: 0 for success, with src->len 0 at the end of the
+ *          file, 3 for I/O error
+ */
+INT_STAT source_next(struct source *src)
+{
+#ifdef _POSIX_VERSION
+	void *map;
+#endif
+
+	if (!src->fp) {
+		src->pos += src->len;
+		src->len = src->size - src->pos;
+		return INT_SUCC;
+	}
+
+#ifdef _POSIX_VERSION
+
+	if (src->mapped) {
+		if (src->len)
+			munmap(src->str, src->len);
+		src->pos += src->len;
+		src->str = NULL;
+		src->len = src->size - src->pos;
+		if (src->len > SOURCE_WINDOW)
+			src->len = SOURCE_WINDOW;
+		if (!src->len)
+			return INT_SUCC;
+
+		map = mmap(NULL, src->len, PROT_READ, MAP_PRIVATE,
+			   fileno(src->fp), (off_t) src->pos);
+		if (map == MAP_FAILED) {
+			src->len = 0;
+			return INT_IOERR;
+		}
+		posix_madvise(map, src->len, POSIX_MADV_SEQUENTIAL);
+		src->str = (char *) map;
+		return INT_SUCC;
+	}
+#endif
+
+	src->len = fread(src->str, 1, IO_BUFSIZE, src->fp);
+
+	return ferror(src->fp) ? INT_IOERR : INT_SUCC;
+}
+
+void source_close(struct source *src)
+{
+	if (!src->fp) {
+		src->str = NULL;
+		return;
+	}
+#ifdef _POSIX_VERSION
+	if (src->mapped) {
+		if (src->len)
+			munmap(src->str, src->len);
+		src->str = NULL;
+		src->len = 0;
+		return;
+	}
+#endif
+	free(src->str);
+	src->str = NULL;
+}
@@ -0,0 +1,996 @@
+/*
+ * A JIT compiler for x86-64 and AArch64.
+ *
+ * Each instruction of an optimized program is translated into
+ * native code, which is run straight out of an mmap'd region.
+ * The generated code keeps the pointer, the bounds of the tape
+ * and the budget for the limits in callee-saved registers, and
+ * calls back into C for anything slow: growing the tape, scanning
+ * it, all I/O and getting more budget, see limit.c.
+ *
+ * On anything else, jit_compile() just returns NULL and the
+ * caller falls back to the interpreter.
+ */
+
+#if (defined(__x86_64__) || defined(__aarch64__)) && defined(__unix__)
+#define JIT_SUPPORTED
+#define _POSIX_C_SOURCE 200809L
+#define _DEFAULT_SOURCE
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef JIT_SUPPORTED
+#include <sys/mman.h>
+#ifndef MAP_ANONYMOUS
+#define MAP_ANONYMOUS MAP_ANON
+#endif
+#endif
+
+#include "bfint.h"
+
+/*
+ * Everything the generated code needs from C. It's passed in
+ * as the second argument, and the generated code addresses it
+ * with small constant offsets, so the fields here should stay
+ * pointer-sized and few.
+ */
+struct jit_env {
+	unsigned char *lo;	/* lowest the pointer can go */
+	unsigned char *hi;	/* highest the pointer can go */
+	unsigned char *(*grow)(struct jit_env *env, unsigned char *ptr,
+			       long n);
+	int (*out)(struct jit_env *env, int c);
+	int (*in)(struct jit_env *env, unsigned char *ptr);
+	unsigned char *(*scan)(struct jit_env *env, unsigned char *ptr,
+			       long n);
+	long (*more)(struct jit_env *env, long left, size_t pc,
+		     unsigned char *ptr);
+	struct tape *tape;
+	long margin;
+	struct io *io;
+	struct limit *limit;
+	long left;		/* the budget to start with */
+	void *start;		/* the code to start at */
+};
+
+typedef INT_STAT (*jit_fn)(unsigned char *ptr, struct jit_env *env);
+
+/* addr holds where the code for each instruction starts */
+struct jit {
+	void *code;
+	size_t size;
+	jit_fn fn;
+	long margin;
+	size_t *addr;
+};
+
+#ifdef JIT_SUPPORTED
+
+/* code being generated, before it is copied to executable memory */
+struct buf {
+	unsigned char *code;
+	size_t len;
+	size_t cap;
+	int err;
+};
+
+#define ENV_OFF(field) ((unsigned long) offsetof(struct jit_env, field))
+
+static void put(struct buf *b, const void *data, size_t n)
+{
+	unsigned char *code;
+
+	if (b->err)
+		return;
+
+	if (b->len + n > b->cap) {
+		if (b->cap > SIZE_MAX / 2) {
+			b->err = 1;
+			return;
+		}
+
+		code = (unsigned char *) realloc(b->code, b->cap * 2);
+		if (!code) {
+			b->err = 1;
+			return;
+		}
+
+		b->code = code;
+		b->cap *= 2;
+	}
+
+	memcpy(b->code + b->len, data, n);
+	b->len += n;
+}
+
+/*
+ * Both architectures are little-endian, so multi-byte values
+ * are written out lowest byte first.
+ */
+static void put32(struct buf *b, unsigned long v)
+{
+	unsigned char bytes[4];
+
+	bytes[0] = v & 0xff;
+	bytes[1] = (v >> 8) & 0xff;
+	bytes[2] = (v >> 16) & 0xff;
+	bytes[3] = (v >> 24) & 0xff;
+	put(b, bytes, 4);
+}
+
+static void patch32(struct buf *b, size_t at, unsigned long v)
+{
+	if (b->err)
+		return;
+
+	b->code[at] = v & 0xff;
+	b->code[at + 1] = (v >> 8) & 0xff;
+	b->code[at + 2] = (v >> 16) & 0xff;
+	b->code[at + 3] = (v >> 24) & 0xff;
+}
+
+/* whether v survives being stored in a signed 32-bit immediate */
+static int fits32(long v)
+{
+	return v >= -2147483647L && v <= 2147483647L;
+}
+
+#endif /* JIT_SUPPORTED */
+
+#if defined(JIT_SUPPORTED) && defined(__x86_64__)
+
+/*
+ * x86-64, System V calling convention.
+ *
+ *   rbx  pointer
+ *   r12  struct jit_env
+ *   r13  lowest the pointer can go
+ *   r14  highest the pointer can go
+ *   r15  budget left
+ *
+ * The code starts with the four ways out of the function, so
+ * every jump to them is a backward jump to a known address.
+ * The function itself starts right after them.
+ */
+
+#define X86_MEMERR	0
+#define X86_IOERR	7
+#define X86_LIMIT	14
+#define X86_RET		21
+
+/* jump with a 32-bit displacement; op is 0xe9 or 0x0f 0x8X */
+static size_t x86_jump(struct buf *b, int op, size_t to)
+{
+	unsigned char bytes[2];
+	size_t at;
+
+	if (op == 0xe9) {
+		bytes[0] = 0xe9;
+		put(b, bytes, 1);
+	} else {
+		bytes[0] = 0x0f;
+		bytes[1] = op;
+		put(b, bytes, 2);
+	}
+
+	at = b->len;
+	put32(b, (unsigned long) (to - (at + 4)));
+
+	return at;
+}
+
+/* points the displacement at the given address to the current one */
+static void x86_land(struct buf *b, size_t at)
+{
+	patch32(b, at, (unsigned long) (b->len - (at + 4)));
+}
+
+/* reloads the bounds of the tape after a call to grow() */
+static void x86_bounds(struct buf *b)
+{
+	unsigned char bytes[10];
+
+	/* mov r13, [r12 + lo]; mov r14, [r12 + hi] */
+	memcpy(bytes, "\x4d\x8b\x6c\x24\x00\x4d\x8b\x74\x24\x00", 10);
+	bytes[4] = ENV_OFF(lo);
+	bytes[9] = ENV_OFF(hi);
+	put(b, bytes, 10);
+}
+
+/* moves the pointer by n, growing the tape if it runs off */
+static void x86_move(struct buf *b, long n)
+{
+	unsigned char bytes[5];
+	size_t skip;
+
+	/* lea rax, [rbx + n]; cmp rax, r13 or r14 */
+	put(b, "\x48\x8d\x83", 3);
+	put32(b, (unsigned long) n);
+	put(b, n < 0 ? "\x4c\x39\xe8" : "\x4c\x39\xf0", 3);
+
+	/* jae or jbe past the call to grow() */
+	bytes[0] = n < 0 ? 0x73 : 0x76;
+	bytes[1] = 0;
+	put(b, bytes, 2);
+	skip = b->len;
+
+	/* mov rdi, r12; mov rsi, rbx; mov rdx, n; call [r12 + grow] */
+	put(b, "\x4c\x89\xe7\x48\x89\xde\x48\xc7\xc2", 9);
+	put32(b, (unsigned long) n);
+	memcpy(bytes, "\x41\xff\x54\x24\x00", 5);
+	bytes[4] = ENV_OFF(grow);
+	put(b, bytes, 5);
+
+	/* test rax, rax; jz memerr; mov rbx, rax */
+	put(b, "\x48\x85\xc0", 3);
+	x86_jump(b, 0x84, X86_MEMERR);
+	put(b, "\x48\x89\xc3", 3);
+	x86_bounds(b);
+
+	/* lea rax, [rbx + n] */
+	put(b, "\x48\x8d\x83", 3);
+	put32(b, (unsigned long) n);
+
+	if (!b->err)
+		b->code[skip - 1] = (unsigned char) (b->len - skip);
+
+	/* mov rbx, rax */
+	put(b, "\x48\x89\xc3", 3);
+}
+
+/* moves the pointer to the next zero cell, see jit_scan() */
+static void x86_scan(struct buf *b, long n)
+{
+	unsigned char bytes[5];
+
+	/* mov rdi, r12; mov rsi, rbx; mov rdx, n; call [r12 + scan] */
+	put(b, "\x4c\x89\xe7\x48\x89\xde\x48\xc7\xc2", 9);
+	put32(b, (unsigned long) n);
+	memcpy(bytes, "\x41\xff\x54\x24\x00", 5);
+	bytes[4] = ENV_OFF(scan);
+	put(b, bytes, 5);
+
+	/* test rax, rax; jz memerr; mov rbx, rax */
+	put(b, "\x48\x85\xc0", 3);
+	x86_jump(b, 0x84, X86_MEMERR);
+	put(b, "\x48\x89\xc3", 3);
+	x86_bounds(b);
+}
+
+static void x86_op(struct buf *b, const struct op *op, size_t *addr,
+		   size_t i)
+{
+	unsigned char bytes[5];
+	size_t at;
+
+	switch (op->kind) {
+	case OP_ADD:
+		/* add byte [rbx + off], arg */
+		put(b, "\x80\x83", 2);
+		put32(b, (unsigned long) op->off);
+		bytes[0] = (unsigned char) op->arg;
+		put(b, bytes, 1);
+		break;
+	case OP_SET:
+		/* mov byte [rbx + off], arg */
+		put(b, "\xc6\x83", 2);
+		put32(b, (unsigned long) op->off);
+		bytes[0] = (unsigned char) op->arg;
+		put(b, bytes, 1);
+		break;
+	case OP_MOVE:
+		x86_move(b, op->arg);
+		break;
+	case OP_OUT:
+		/* mov rdi, r12; movzx esi, byte [rbx + off]; call [r12 + out] */
+		put(b, "\x4c\x89\xe7\x0f\xb6\xb3", 6);
+		put32(b, (unsigned long) op->off);
+		memcpy(bytes, "\x41\xff\x54\x24\x00", 5);
+		bytes[4] = ENV_OFF(out);
+		put(b, bytes, 5);
+
+		/* test eax, eax; jnz ioerr */
+		put(b, "\x85\xc0", 2);
+		x86_jump(b, 0x85, X86_IOERR);
+		break;
+	case OP_IN:
+		/* mov rdi, r12; lea rsi, [rbx + off]; call [r12 + in] */
+		put(b, "\x4c\x89\xe7\x48\x8d\xb3", 6);
+		put32(b, (unsigned long) op->off);
+		memcpy(bytes, "\x41\xff\x54\x24\x00", 5);
+		bytes[4] = ENV_OFF(in);
+		put(b, bytes, 5);
+
+		/* test eax, eax; jnz ioerr */
+		put(b, "\x85\xc0", 2);
+		x86_jump(b, 0x85, X86_IOERR);
+		break;
+	case OP_JZ:
+		/* cmp byte [rbx], 0; jz past the matching JNZ */
+		put(b, "\x80\x3b\x00", 3);
+		x86_jump(b, 0x84, 0);
+		break;
+	case OP_JNZ:
+		/* cmp byte [rbx], 0; jz out of the loop */
+		put(b, "\x80\x3b\x00\x74\x00", 5);
+		at = b->len;
+
+		/* sub r15, length of the loop; jns past the matching JZ */
+		put(b, "\x49\x81\xef", 3);
+		put32(b, (unsigned long) (i - op->arg));
+		x86_jump(b, 0x89, addr[op->arg + 1]);
+
+		/* mov rdi, r12; mov rsi, r15; mov edx, pc; mov rcx, rbx */
+		put(b, "\x4c\x89\xe7\x4c\x89\xfe\xba", 7);
+		put32(b, (unsigned long) op->arg + 1);
+		put(b, "\x48\x89\xd9", 3);
+
+		/* call [r12 + more] */
+		memcpy(bytes, "\x41\xff\x54\x24\x00", 5);
+		bytes[4] = ENV_OFF(more);
+		put(b, bytes, 5);
+
+		/* test rax, rax; jle limit; mov r15, rax; jmp back */
+		put(b, "\x48\x85\xc0", 3);
+		x86_jump(b, 0x8e, X86_LIMIT);
+		put(b, "\x49\x89\xc7", 3);
+		x86_jump(b, 0xe9, addr[op->arg + 1]);
+		if (!b->err)
+			b->code[at - 1] = (unsigned char) (b->len - at);
+		x86_land(b, addr[op->arg] + 5);
+		break;
+	case OP_MUL:
+		/* movzx eax, byte [rbx]; imul eax, eax, arg */
+		put(b, "\x0f\xb6\x03\x69\xc0", 5);
+		put32(b, (unsigned long) op->arg & 0xff);
+
+		/* add byte [rbx + off], al */
+		put(b, "\x00\x83", 2);
+		put32(b, (unsigned long) op->off);
+		break;
+	case OP_SCAN:
+		/* cmp byte [rbx], 0; jz out of the loop */
+		put(b, "\x80\x3b\x00", 3);
+		at = x86_jump(b, 0x84, 0);
+		if (op->arg <= SCAN_MAX && op->arg >= -SCAN_MAX) {
+			x86_scan(b, op->arg);
+		} else {
+			x86_move(b, op->arg);
+			x86_jump(b, 0xe9, addr[i]);
+		}
+		x86_land(b, at);
+		break;
+	case OP_END:
+		/* xor eax, eax; jmp ret */
+		put(b, "\x31\xc0", 2);
+		x86_jump(b, 0xe9, X86_RET);
+		break;
+	}
+}
+
+static size_t gen(struct buf *b, const struct program *prog, size_t *addr)
+{
+	unsigned char bytes[5];
+	size_t i, entry;
+
+	/* memerr: mov eax, INT_MEMERR; jmp ret */
+	bytes[0] = 0xb8;
+	put(b, bytes, 1);
+	put32(b, INT_MEMERR);
+	bytes[0] = 0xeb;
+	bytes[1] = X86_RET - (X86_MEMERR + 7);
+	put(b, bytes, 2);
+
+	/* ioerr: mov eax, INT_IOERR; jmp ret */
+	bytes[0] = 0xb8;
+	put(b, bytes, 1);
+	put32(b, INT_IOERR);
+	bytes[0] = 0xeb;
+	bytes[1] = X86_RET - (X86_IOERR + 7);
+	put(b, bytes, 2);
+
+	/* limit: mov eax, INT_LIMIT; jmp ret */
+	bytes[0] = 0xb8;
+	put(b, bytes, 1);
+	put32(b, INT_LIMIT);
+	bytes[0] = 0xeb;
+	bytes[1] = X86_RET - (X86_LIMIT + 7);
+	put(b, bytes, 2);
+
+	/* ret: pop r15; pop r14; pop r13; pop r12; pop rbx; ret */
+	put(b, "\x41\x5f\x41\x5e\x41\x5d\x41\x5c\x5b\xc3", 10);
+
+	/* push rbx; push r12; push r13; push r14; push r15 */
+	entry = b->len;
+	put(b, "\x53\x41\x54\x41\x55\x41\x56\x41\x57", 9);
+
+	/* mov rbx, rdi; mov r12, rsi; mov r15, [r12 + left] */
+	put(b, "\x48\x89\xfb\x49\x89\xf4\x4d\x8b\x7c\x24", 10);
+	bytes[0] = ENV_OFF(left);
+	put(b, bytes, 1);
+	x86_bounds(b);
+
+	/* jmp [r12 + start] */
+	memcpy(bytes, "\x41\xff\x64\x24\x00", 5);
+	bytes[4] = ENV_OFF(start);
+	put(b, bytes, 5);
+
+	/* the pc handed to more is an unsigned 32-bit immediate */
+	if (prog->len > 0xffffffffUL)
+		b->err = 1;
+
+	for (i = 0; i < prog->len; ++i) {
+		if (prog->ops[i].kind == OP_MOVE || prog->ops[i].kind == OP_SCAN)
+			if (!fits32(prog->ops[i].arg))
+				b->err = 1;
+		addr[i] = b->len;
+		x86_op(b, &prog->ops[i], addr, i);
+	}
+
+	return entry;
+}
+
+#endif /* x86-64 */
+
+#if defined(JIT_SUPPORTED) && defined(__aarch64__)
+
+/*
+ * AArch64, AAPCS64 calling convention.
+ *
+ *   x19  pointer
+ *   x20  struct jit_env
+ *   x21  lowest the pointer can go
+ *   x22  highest the pointer can go
+ *   x23  budget left
+ *   x9-x12 scratch
+ *
+ * Like on x86-64, the ways out of the function come first. All
+ * long jumps are unconditional B instructions, with a short
+ * conditional branch around them, since the conditional ones
+ * only reach 1 MiB.
+ */
+
+#define A64_MEMERR	0
+#define A64_IOERR	8
+#define A64_LIMIT	16
+#define A64_RET		24
+
+#define A64_PTR		19
+#define A64_ENV		20
+#define A64_LO		21
+#define A64_HI		22
+#define A64_LEFT	23
+
+static void a64(struct buf *b, unsigned long insn)
+{
+	put32(b, insn);
+}
+
+/* b to the given address */
+static size_t a64_b(struct buf *b, size_t to)
+{
+	size_t at = b->len;
+	long delta = ((long) to - (long) at) / 4;
+
+	if (delta < -(1L << 25) || delta >= (1L << 25))
+		b->err = 1;
+
+	a64(b, 0x14000000UL | ((unsigned long) delta & 0x3ffffff));
+
+	return at;
+}
+
+/* points the b at the given address to the current one */
+static void a64_land(struct buf *b, size_t at)
+{
+	long delta = ((long) b->len - (long) at) / 4;
+
+	if (delta >= (1L << 25))
+		b->err = 1;
+
+	patch32(b, at, 0x14000000UL | ((unsigned long) delta & 0x3ffffff));
+}
+
+/* mov xd, xm */
+static void a64_mov(struct buf *b, int d, int m)
+{
+	a64(b, 0xaa0003e0UL | (unsigned long) m << 16 | d);
+}
+
+/* loads any 64-bit constant into xd */
+static void a64_imm(struct buf *b, int d, long v)
+{
+	unsigned long u = (unsigned long) v;
+	int hw;
+
+	/* movz xd, #(u & 0xffff) */
+	a64(b, 0xd2800000UL | (u & 0xffff) << 5 | d);
+
+	/* movk xd, #part, lsl #(16 * hw) */
+	for (hw = 1; hw < 4; ++hw)
+		if ((u >> (16 * hw)) & 0xffff)
+			a64(b, 0xf2800000UL | (unsigned long) hw << 21 |
+			    ((u >> (16 * hw)) & 0xffff) << 5 | d);
+}
+
+/* ldr xt, [x20 + off] */
+static void a64_env(struct buf *b, int t, unsigned long off)
+{
+	a64(b, 0xf9400000UL | (off / 8) << 10 | A64_ENV << 5 | t);
+}
+
+/* calls the function pointer at the given offset into the env */
+static void a64_call(struct buf *b, unsigned long off)
+{
+	a64_mov(b, 0, A64_ENV);
+	a64_env(b, 16, off);
+	a64(b, 0xd63f0200UL);	/* blr x16 */
+}
+
+/*
+ * Returns the register holding the address of cell off, which
+ * is either x19 itself or x9.
+ */
+static int a64_cell(struct buf *b, int off)
+{
+	if (!off)
+		return A64_PTR;
+
+	if (off > 0 && off < 4096)	/* add x9, x19, #off */
+		a64(b, 0x91000000UL | (unsigned long) off << 10 |
+		    A64_PTR << 5 | 9);
+	else if (off < 0 && off > -4096)	/* sub x9, x19, #-off */
+		a64(b, 0xd1000000UL | (unsigned long) -off << 10 |
+		    A64_PTR << 5 | 9);
+	else {	/* add x9, x19, x9 */
+		a64_imm(b, 9, off);
+		a64(b, 0x8b000000UL | 9UL << 16 | A64_PTR << 5 | 9);
+	}
+
+	return 9;
+}
+
+/* ldrb wt, [xn] and strb wt, [xn] */
+#define A64_LDRB(t, n) (0x39400000UL | (unsigned long) (n) << 5 | (t))
+#define A64_STRB(t, n) (0x39000000UL | (unsigned long) (n) << 5 | (t))
+
+/* moves the pointer by n, growing the tape if it runs off */
+static void a64_move(struct buf *b, long n)
+{
+	size_t skip;
+
+	/* x9 = x19 + n; cmp x9, x21 or x22 */
+	a64_imm(b, 9, n);
+	a64(b, 0x8b000000UL | 9UL << 16 | A64_PTR << 5 | 9);
+	a64(b, 0xeb00001fUL | (unsigned long) (n < 0 ? A64_LO : A64_HI) << 16 |
+	    9 << 5);
+
+	/* b.hs or b.ls past the call to grow(), patched below */
+	skip = b->len;
+	a64(b, 0);
+
+	a64_mov(b, 1, A64_PTR);
+	a64_imm(b, 2, n);
+	a64_call(b, ENV_OFF(grow));
+
+	/* cbnz x0, +8; b memerr */
+	a64(b, 0xb5000040UL);
+	a64_b(b, A64_MEMERR);
+	a64_mov(b, A64_PTR, 0);
+	a64_env(b, A64_LO, ENV_OFF(lo));
+	a64_env(b, A64_HI, ENV_OFF(hi));
+
+	a64_imm(b, 9, n);
+	a64(b, 0x8b000000UL | 9UL << 16 | A64_PTR << 5 | 9);
+
+	patch32(b, skip, 0x54000000UL |
+		(unsigned long) ((b->len - skip) / 4) << 5 | (n < 0 ? 2 : 9));
+
+	a64_mov(b, A64_PTR, 9);
+}
+
+/* moves the pointer to the next zero cell, see jit_scan() */
+static void a64_scan(struct buf *b, long n)
+{
+	a64_mov(b, 1, A64_PTR);
+	a64_imm(b, 2, n);
+	a64_call(b, ENV_OFF(scan));
+
+	/* cbnz x0, +8; b memerr */
+	a64(b, 0xb5000040UL);
+	a64_b(b, A64_MEMERR);
+	a64_mov(b, A64_PTR, 0);
+	a64_env(b, A64_LO, ENV_OFF(lo));
+	a64_env(b, A64_HI, ENV_OFF(hi));
+}
+
+static void a64_op(struct buf *b, const struct op *op, size_t *addr,
+		   size_t i)
+{
+	size_t at;
+	int r;
+
+	switch (op->kind) {
+	case OP_ADD:
+		/* ldrb w10, [cell]; add w10, w10, #arg; strb w10, [cell] */
+		r = a64_cell(b, op->off);
+		a64(b, A64_LDRB(10, r));
+		a64(b, 0x11000000UL | ((unsigned long) op->arg & 0xff) << 10 |
+		    10 << 5 | 10);
+		a64(b, A64_STRB(10, r));
+		break;
+	case OP_SET:
+		/* movz w10, #arg; strb w10, [cell] */
+		r = a64_cell(b, op->off);
+		a64(b, 0x52800000UL | ((unsigned long) op->arg & 0xff) << 5 | 10);
+		a64(b, A64_STRB(10, r));
+		break;
+	case OP_MOVE:
+		a64_move(b, op->arg);
+		break;
+	case OP_OUT:
+		/* ldrb w1, [cell]; call out; cbz w0, +8; b ioerr */
+		a64(b, A64_LDRB(1, a64_cell(b, op->off)));
+		a64_call(b, ENV_OFF(out));
+		a64(b, 0x34000040UL);
+		a64_b(b, A64_IOERR);
+		break;
+	case OP_IN:
+		/* mov x1, cell; call in; cbz w0, +8; b ioerr */
+		a64_mov(b, 1, a64_cell(b, op->off));
+		a64_call(b, ENV_OFF(in));
+		a64(b, 0x34000040UL);
+		a64_b(b, A64_IOERR);
+		break;
+	case OP_JZ:
+		/* ldrb w10, [x19]; cbnz w10, +8; b past the matching JNZ */
+		a64(b, A64_LDRB(10, A64_PTR));
+		a64(b, 0x3500004aUL);
+		a64_b(b, 0);
+		break;
+	case OP_JNZ:
+		/* ldrb w10, [x19]; cbz w10, out of the loop */
+		a64(b, A64_LDRB(10, A64_PTR));
+		at = b->len;
+		a64(b, 0);
+
+		/* subs x23, x23, length of the loop */
+		if (i - op->arg < 4096) {
+			a64(b, 0xf1000000UL | (i - op->arg) << 10 |
+			    A64_LEFT << 5 | A64_LEFT);
+		} else {
+			a64_imm(b, 9, (long) (i - op->arg));
+			a64(b, 0xeb000000UL | 9UL << 16 | A64_LEFT << 5 |
+			    A64_LEFT);
+		}
+
+		/* b.mi +8; b past the matching JZ */
+		a64(b, 0x54000044UL);
+		a64_b(b, addr[op->arg + 1]);
+
+		/* call more with the budget, pc and pointer */
+		a64_mov(b, 1, A64_LEFT);
+		a64_imm(b, 2, op->arg + 1);
+		a64_mov(b, 3, A64_PTR);
+		a64_call(b, ENV_OFF(more));
+
+		/* cmp x0, #0; b.gt +8; b limit; mov x23, x0 */
+		a64(b, 0xf100001fUL);
+		a64(b, 0x5400004cUL);
+		a64_b(b, A64_LIMIT);
+		a64_mov(b, A64_LEFT, 0);
+		a64_b(b, addr[op->arg + 1]);
+
+		patch32(b, at, 0x34000000UL |
+			(unsigned long) ((b->len - at) / 4) << 5 | 10);
+		a64_land(b, addr[op->arg] + 8);
+		break;
+	case OP_MUL:
+		/* ldrb w10, [x19]; movz w11, #arg; mul w10, w10, w11 */
+		a64(b, A64_LDRB(10, A64_PTR));
+		a64(b, 0x52800000UL | ((unsigned long) op->arg & 0xff) << 5 | 11);
+		a64(b, 0x1b007c00UL | 11UL << 16 | 10 << 5 | 10);
+
+		/* ldrb w12, [cell]; add w12, w12, w10; strb w12, [cell] */
+		r = a64_cell(b, op->off);
+		a64(b, A64_LDRB(12, r));
+		a64(b, 0x0b000000UL | 10UL << 16 | 12 << 5 | 12);
+		a64(b, A64_STRB(12, r));
+		break;
+	case OP_SCAN:
+		/* ldrb w10, [x19]; cbnz w10, +8; b out of the loop */
+		a64(b, A64_LDRB(10, A64_PTR));
+		a64(b, 0x3500004aUL);
+		at = a64_b(b, 0);
+		if (op->arg <= SCAN_MAX && op->arg >= -SCAN_MAX) {
+			a64_scan(b, op->arg);
+		} else {
+			a64_move(b, op->arg);
+			a64_b(b, addr[i]);
+		}
+		a64_land(b, at);
+		break;
+	case OP_END:
+		/* movz w0, #0; b ret */
+		a64(b, 0x52800000UL);
+		a64_b(b, A64_RET);
+		break;
+	}
+}
+
+static size_t gen(struct buf *b, const struct program *prog, size_t *addr)
+{
+	size_t i, entry;
+
+	/* memerr: movz w0, #INT_MEMERR; b ret */
+	a64(b, 0x52800000UL | (unsigned long) INT_MEMERR << 5);
+	a64_b(b, A64_RET);
+
+	/* ioerr: movz w0, #INT_IOERR; b ret */
+	a64(b, 0x52800000UL | (unsigned long) INT_IOERR << 5);
+	a64_b(b, A64_RET);
+
+	/* limit: movz w0, #INT_LIMIT; b ret */
+	a64(b, 0x52800000UL | (unsigned long) INT_LIMIT << 5);
+	a64_b(b, A64_RET);
+
+	/* ret: restore x19-x24, the frame pointer and the link register */
+	a64(b, 0xa94363f7UL);	/* ldp x23, x24, [sp, #48] */
+	a64(b, 0xa9425bf5UL);	/* ldp x21, x22, [sp, #32] */
+	a64(b, 0xa94153f3UL);	/* ldp x19, x20, [sp, #16] */
+	a64(b, 0xa8c47bfdUL);	/* ldp x29, x30, [sp], #64 */
+	a64(b, 0xd65f03c0UL);	/* ret */
+
+	entry = b->len;
+	a64(b, 0xa9bc7bfdUL);	/* stp x29, x30, [sp, #-64]! */
+	a64(b, 0x910003fdUL);	/* mov x29, sp */
+	a64(b, 0xa90153f3UL);	/* stp x19, x20, [sp, #16] */
+	a64(b, 0xa9025bf5UL);	/* stp x21, x22, [sp, #32] */
+	a64(b, 0xa90363f7UL);	/* stp x23, x24, [sp, #48] */
+	a64_mov(b, A64_PTR, 0);
+	a64_mov(b, A64_ENV, 1);
+	a64_env(b, A64_LO, ENV_OFF(lo));
+	a64_env(b, A64_HI, ENV_OFF(hi));
+	a64_env(b, A64_LEFT, ENV_OFF(left));
+	a64_env(b, 16, ENV_OFF(start));
+	a64(b, 0xd61f0200UL);	/* br x16 */
+
+	for (i = 0; i < prog->len; ++i) {
+		addr[i] = b->len;
+		a64_op(b, &prog->ops[i], addr, i);
+	}
+
+	return entry;
+}
+
+#endif /* AArch64 */
+
+#ifdef JIT_SUPPORTED
+
+/*
+ * About what compiling costs, in steps of the interpreter: a few
+ * microseconds to map the code, and some tens of nanoseconds for
+ * each instruction.
+ */
+#define JIT_HOT_BASE 8192
+#define JIT_HOT_OP 64
+
+/*
+ * How many steps a program should run on the interpreter before
+ * moving to the JIT, see limit.c. That's about what compiling it
+ * would cost, so a program that's done by then never pays for
+ * compiling, and one that isn't pays at most twice what it would
+ * have if it had been compiled right away.
+ *
+ * returns: the steps, or -1 if the JIT isn't supported here
+ */
+double jit_hot(const struct program *prog)
+{
+	return JIT_HOT_BASE + JIT_HOT_OP * (double) prog->len;
+}
+
+/*
+ * Translates a program into native code.
+ *
+ * args: program from optimize()
+ * returns: the compiled program, or NULL if the JIT isn't
+ *          supported here or something went wrong
+ */
+struct jit *jit_compile(const struct program *prog)
+{
+	struct jit *jit;
+	struct buf b;
+	size_t *addr, entry;
+	void *code;
+
+	if (prog->len > SIZE_MAX / sizeof(size_t))
+		return NULL;
+
+	b.code = (unsigned char *) malloc(4096);
+	b.len = 0;
+	b.cap = 4096;
+	b.err = !b.code;
+
+	addr = (size_t *) malloc(prog->len * sizeof(size_t));
+	if (!addr)
+		b.err = 1;
+
+	entry = b.err ? 0 : gen(&b, prog, addr);
+
+	jit = b.err ? NULL : (struct jit *) malloc(sizeof(struct jit));
+	if (!jit) {
+		free(addr);
+		free(b.code);
+		return NULL;
+	}
+
+	/*
+	 * The code is written while the memory is still writable,
+	 * and only then made executable, so that the memory is
+	 * never both at once.
+	 */
+	code = mmap(NULL, b.len, PROT_READ | PROT_WRITE,
+		    MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (code == MAP_FAILED) {
+		free(addr);
+		free(b.code);
+		free(jit);
+		return NULL;
+	}
+
+	memcpy(code, b.code, b.len);
+	free(b.code);
+
+	if (mprotect(code, b.len, PROT_READ | PROT_EXEC)) {
+		munmap(code, b.len);
+		free(addr);
+		free(jit);
+		return NULL;
+	}
+
+	__builtin___clear_cache((char *) code, (char *) code + b.len);
+
+	/*
+	 * ISO C doesn't allow converting a data pointer to a
+	 * function pointer, so the address is copied over instead.
+	 */
+	code = (char *) code + entry;
+	memcpy(&jit->fn, &code, sizeof(jit->fn));
+	jit->code = (char *) code - entry;
+	jit->size = b.len;
+	jit->margin = (long) prog->margin;
+	jit->addr = addr;
+
+	return jit;
+}
+
+void jit_free(struct jit *jit)
+{
+	munmap(jit->code, jit->size);
+	free(jit->addr);
+	free(jit);
+}
+
+#else
+
+double jit_hot(const struct program *prog)
+{
+	(void) prog;
+	return -1;
+}
+
+struct jit *jit_compile(const struct program *prog)
+{
+	(void) prog;
+	return NULL;
+}
+
+void jit_free(struct jit *jit)
+{
+	(void) jit;
+}
+
+#endif /* JIT_SUPPORTED */
+
+/*
+ * Called by the generated code when the pointer is about to
+ * run off the tape. Unlike tape_grow(), it also keeps margin
+ * cells on both sides the same way interpret() does, and
+ * updates the bounds, which the generated code then reloads.
+ */
+static unsigned char *jit_grow(struct jit_env *env, unsigned char *ptr,
+			       long n)
+{
+	ptr = tape_grow(env->tape, ptr,
+			n < 0 ? n - env->margin : n + env->margin);
+	if (ptr) {
+		env->lo = env->tape->cells + env->margin;
+		env->hi = env->tape->cells + env->tape->len - 1 - env->margin;
+	}
+
+	return ptr;
+}
+
+/*
+ * Called by the generated code for OP_SCAN when the current cell
+ * isn't zero: moves the pointer to the next one that is, n cells
+ * at a time, and grows the tape like jit_grow() if that's past
+ * either end.
+ */
+static unsigned char *jit_scan(struct jit_env *env, unsigned char *ptr,
+			       long n)
+{
+	struct tape *tape = env->tape;
+	long d;
+
+	d = n > 0 ? (long) scan_right(ptr, tape->cells + tape->len - ptr,
+				      (size_t) n, 1)
+		  : -(long) scan_left(ptr, ptr + 1 - tape->cells,
+				      (size_t) -n, 1);
+	if (d > 0 ? d > env->hi - ptr : d < env->lo - ptr)
+		ptr = jit_grow(env, ptr, d);
+
+	return ptr ? ptr + d : NULL;
+}
+
+static int jit_out(struct jit_env *env, int c)
+{
+	return IO_PUT(env->io, c);
+}
+
+/* stores the byte itself, since at the end of input it may not */
+static int jit_in(struct jit_env *env, unsigned char *ptr)
+{
+	int c = IO_GET(env->io);
+
+	if (c == IO_ERR)
+		return 1;
+	if (c != IO_KEEP)
+		*ptr = (unsigned char) c;
+
+	return 0;
+}
+
+static long jit_more(struct jit_env *env, long left, size_t pc,
+		     unsigned char *ptr)
+{
+	return limit_more(env->limit, left, pc, ptr);
+}
+
+/*
+ * Runs a program compiled by jit_compile().
+ *
+ * args: compiled program, tape to run on, I/O state, limits on
+ *       the run or NULL
+ * returns: 0 for success, 2 for bad memory allocation,
+ *          3 for I/O error, 5 if a limit was reached
+ */
+INT_STAT jit_run(struct jit *jit, struct tape *tape, struct io *io,
+		 struct limit *limit)
+{
+	struct jit_env env;
+	unsigned char *ptr;
+
+	ptr = tape_reserve(tape, tape->cells + tape->origin, jit->margin);
+	if (!ptr)
+		return INT_MEMERR;
+
+	env.lo = tape->cells + jit->margin;
+	env.hi = tape->cells + tape->len - 1 - jit->margin;
+	env.grow = jit_grow;
+	env.out = jit_out;
+	env.in = jit_in;
+	env.scan = jit_scan;
+	env.more = jit_more;
+	env.tape = tape;
+	env.margin = jit->margin;
+	env.io = io;
+	env.limit = limit;
+	env.left = limit_start(limit);
+	env.start = (char *) jit->code + jit->addr[limit ? limit->pc : 0];
+
+	return jit->fn(ptr, &env);
+}
@@ -0,0 +1,346 @@
+/*
+ * The library in bf.h. It's the same compiler and engines as bf,
+ * with an I/O state and a tape for each context instead of the
+ * ones main() has, and memory or callbacks where bf has stdin and
+ * stdout.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "bf.h"
+#include "bfint.h"
+
+/*
+ * whole is the program before precompute(), for runs with a limit
+ * on their steps or time, which have to count the start of it too.
+ * Its ops are NULL if precompute() didn't change anything, and
+ * then prog is run either way.
+ */
+struct bf_program {
+	struct program prog;
+	struct program whole;
+	struct jit *jit;	/* NULL unless the JIT is running it */
+	struct jit *whole_jit;
+	int bits;
+	int threaded;
+};
+
+/*
+ * read and write are the callbacks from bf_ctx_io(), if any. in
+ * holds inlen bytes of input from bf_ctx_input(), of which inpos
+ * have been read, and out holds the outlen bytes of output kept so
+ * far, with room for outcap. steps and seconds are the limits from
+ * bf_ctx_limits(), which limit is set up from for each run, and
+ * the limit on the tape is kept in the tape.
+ */
+struct bf_ctx {
+	struct tape tape;
+	struct io io;
+	bf_read_fn read;
+	bf_write_fn write;
+	void *user;
+	const unsigned char *in;
+	size_t inlen;
+	size_t inpos;
+	unsigned char *out;
+	size_t outlen;
+	size_t outcap;
+	double steps;
+	double seconds;
+	struct limit limit;
+};
+
+/*
+ * What a status from the compiler, or from the engines running in
+ * a context if there is one, is in bf.h.
+ */
+static int bf_status(INT_STAT st, const struct bf_ctx *ctx)
+{
+	switch (st) {
+	case INT_SUCC:
+		return BF_OK;
+	case INT_MEMERR:
+		return ctx && ctx->tape.full ? BF_TAPE : BF_NOMEM;
+	case INT_IOERR:
+		return BF_IOERR;
+	case INT_BOUNDS:
+		return BF_TAPE;
+	case INT_LIMIT:
+		return ctx->limit.hit == 't' ? BF_TIMEOUT : BF_STEPS;
+	default:
+		return BF_INVALID;
+	}
+}
+
+struct bf_program *bf_compile(const char *src, size_t len, int bits,
+			      int engine, int *status)
+{
+	struct bf_program *prog;
+	struct source s;
+	INT_STAT st = INT_INVL;
+
+	prog = (struct bf_program *) malloc(sizeof(struct bf_program));
+	if (!prog) {
+		st = INT_MEMERR;
+		goto fail;
+	}
+	prog->prog.ops = NULL;
+	prog->prog.pos = NULL;
+	prog->whole.ops = NULL;
+	prog->jit = NULL;
+	prog->whole_jit = NULL;
+
+	if ((bits != 8 && bits != 16 && bits != 32) ||
+	    (engine != BF_THREADED && engine != BF_SWITCH &&
+	     engine != BF_JIT))
+		goto fail;
+
+	source_string(&s, src, len);
+	st = compile(&prog->prog, &s, 0);
+	source_close(&s);
+	if (st != INT_SUCC)
+		goto fail;
+
+	optimize(&prog->prog);
+	fuse(&prog->prog);
+
+	prog->whole = prog->prog;
+	prog->whole.ops = (struct op *) malloc(prog->prog.len *
+					       sizeof(struct op));
+	if (!prog->whole.ops) {
+		st = INT_MEMERR;
+		goto fail;
+	}
+	memcpy(prog->whole.ops, prog->prog.ops,
+	       prog->prog.len * sizeof(struct op));
+	prog->whole.cap = prog->whole.len;
+
+	st = precompute(&prog->prog, bits);
+	if (st != INT_SUCC)
+		goto fail;
+	if (prog->whole.len == prog->prog.len &&
+	    !memcmp(prog->whole.ops, prog->prog.ops,
+		    prog->prog.len * sizeof(struct op))) {
+		free(prog->whole.ops);
+		prog->whole.ops = NULL;
+	}
+
+	/* the same fallbacks as in main() */
+	if (engine == BF_JIT && bits == 8) {
+		prog->jit = jit_compile(&prog->prog);
+		if (prog->whole.ops)
+			prog->whole_jit = jit_compile(&prog->whole);
+	}
+	prog->bits = bits;
+	prog->threaded = engine != BF_SWITCH;
+
+	if (status)
+		*status = BF_OK;
+	return prog;
+
+fail:
+	if (prog) {
+		free(prog->prog.ops);
+		free(prog->prog.pos);
+		free(prog->whole.ops);
+		free(prog);
+	}
+	if (status)
+		*status = bf_status(st, NULL);
+	return NULL;
+}
+
+void bf_free(struct bf_program *prog)
+{
+	if (!prog)
+		return;
+
+	if (prog->jit)
+		jit_free(prog->jit);
+	if (prog->whole_jit)
+		jit_free(prog->whole_jit);
+	free(prog->prog.ops);
+	free(prog->whole.ops);
+	free(prog);
+}
+
+/* io->read, from the callback or the input in memory */
+static long ctx_read(void *user, unsigned char *buf, size_t len)
+{
+	struct bf_ctx *ctx = (struct bf_ctx *) user;
+
+	if (ctx->read)
+		return ctx->read(ctx->user, buf, len);
+
+	if (len > ctx->inlen - ctx->inpos)
+		len = ctx->inlen - ctx->inpos;
+	if (len)
+		memcpy(buf, ctx->in + ctx->inpos, len);
+	ctx->inpos += len;
+
+	return (long) len;
+}
+
+/* io->write, to the callback or the output kept in memory */
+static int ctx_write(void *user, const unsigned char *buf, size_t len)
+{
+	struct bf_ctx *ctx = (struct bf_ctx *) user;
+	unsigned char *out;
+	size_t cap = ctx->outcap ? ctx->outcap : IO_BUFSIZE;
+
+	if (ctx->write)
+		return ctx->write(ctx->user, buf, len);
+
+	while (cap - ctx->outlen < len) {
+		if (cap > SIZE_MAX / 2)
+			return 1;
+		cap *= 2;
+	}
+	if (cap != ctx->outcap) {
+		out = (unsigned char *) realloc(ctx->out, cap);
+		if (!out)
+			return 1;
+		ctx->out = out;
+		ctx->outcap = cap;
+	}
+
+	memcpy(ctx->out + ctx->outlen, buf, len);
+	ctx->outlen += len;
+
+	return 0;
+}
+
+struct bf_ctx *bf_ctx_new(int eof)
+{
+	struct bf_ctx *ctx;
+
+	if (eof != 0 && eof != -1 && eof != BF_EOF_KEEP)
+		return NULL;
+
+	ctx = (struct bf_ctx *) malloc(sizeof(struct bf_ctx));
+	if (!ctx)
+		return NULL;
+
+	ctx->tape.cells = (unsigned char *) calloc(TAPE_INIT, 1);
+	ctx->tape.len = TAPE_INIT;
+	ctx->tape.origin = 0;
+	ctx->tape.width = 1;
+	ctx->tape.base = NULL;
+	ctx->tape.mapped = 0;
+	ctx->tape.max = 0;
+	ctx->tape.full = 0;
+	ctx->read = NULL;
+	ctx->write = NULL;
+	ctx->user = NULL;
+	ctx->in = NULL;
+	ctx->inlen = 0;
+	ctx->inpos = 0;
+	ctx->out = NULL;
+	ctx->outlen = 0;
+	ctx->outcap = 0;
+	ctx->steps = -1;
+	ctx->seconds = 0;
+
+	if (io_init(&ctx->io, 1, eof) != INT_SUCC || !ctx->tape.cells) {
+		bf_ctx_free(ctx);
+		return NULL;
+	}
+	ctx->io.read = ctx_read;
+	ctx->io.write = ctx_write;
+	ctx->io.user = ctx;
+
+	return ctx;
+}
+
+/* forgets the input that was read ahead from wherever it was */
+static void drop_input(struct bf_ctx *ctx)
+{
+	ctx->io.inpos = 0;
+	ctx->io.inlen = 0;
+}
+
+void bf_ctx_reset(struct bf_ctx *ctx)
+{
+	tape_clear(&ctx->tape);
+	drop_input(ctx);
+	ctx->inpos = 0;
+	ctx->outlen = 0;
+}
+
+void bf_ctx_free(struct bf_ctx *ctx)
+{
+	if (!ctx)
+		return;
+
+	io_free(&ctx->io);
+	tape_free(&ctx->tape);
+	free(ctx->out);
+	free(ctx);
+}
+
+void bf_ctx_io(struct bf_ctx *ctx, bf_read_fn read, bf_write_fn write,
+	       void *user)
+{
+	drop_input(ctx);
+	ctx->read = read;
+	ctx->write = write;
+	ctx->user = user;
+}
+
+void bf_ctx_input(struct bf_ctx *ctx, const void *buf, size_t len)
+{
+	drop_input(ctx);
+	ctx->read = NULL;
+	ctx->in = (const unsigned char *) buf;
+	ctx->inlen = len;
+	ctx->inpos = 0;
+}
+
+void bf_ctx_limits(struct bf_ctx *ctx, double steps, double seconds,
+		   size_t tape)
+{
+	ctx->steps = steps < 0 ? -1 : steps;
+	ctx->seconds = seconds > 0 ? seconds : 0;
+	ctx->tape.max = tape;
+}
+
+const unsigned char *bf_ctx_output(const struct bf_ctx *ctx, size_t *len)
+{
+	*len = ctx->outlen;
+
+	return ctx->out;
+}
+
+int bf_run(struct bf_ctx *ctx, const struct bf_program *prog)
+{
+	struct tape *tape = &ctx->tape;
+	const struct program *run = &prog->prog;
+	struct jit *jit = prog->jit;
+	INT_STAT status;
+
+	if (tape->width != (size_t) prog->bits / 8) {
+		tape_clear(tape);
+		tape->width = (size_t) prog->bits / 8;
+	}
+
+	limit_init(&ctx->limit, ctx->steps, ctx->seconds, 0, -1);
+	tape->full = 0;
+
+	/* a limited run counts the start of the program too */
+	if ((ctx->steps >= 0 || ctx->seconds > 0) && prog->whole.ops) {
+		run = &prog->whole;
+		jit = prog->whole_jit;
+	}
+
+	if (jit)
+		status = jit_run(jit, tape, &ctx->io, &ctx->limit);
+	else
+		status = engines_for(prog->bits)->plain[prog->threaded](tape,
+			run, &ctx->io, &ctx->limit, NULL);
+
+	if (io_flush(&ctx->io) && status == INT_SUCC)
+		status = INT_IOERR;
+
+	return bf_status(status, ctx);
+}
@@ -0,0 +1,153 @@
+/*
+ * The limits on a run, for --max-steps and --timeout.
+ *
+ * Checking them costs almost nothing, because the engines only do
+ * it at the end of a loop: every OP_JNZ that jumps back takes the
+ * length of its loop off a budget the engine keeps in a local or a
+ * register, and only calls limit_more() when that runs out. Straight-line
+ * code can't run for long without getting to one of those, so
+ * nothing else has to check. A step is one compiled instruction
+ * of a loop body going round once, which is the same in every
+ * engine, however it runs the rest.
+ *
+ * With a timeout, the budget is handed out LIMIT_CHUNK steps at a
+ * time, and the clock is only looked at between chunks. That does
+ * what a timer setting a flag would, without a timer or anything
+ * global, but it can't stop a program that's waiting for input.
+ *
+ * --checkpoint-every stops the run the same way when it's time for a
+ * checkpoint. The engines tell limit_more() where they are, and it
+ * keeps that in the limits for the run to be started again from
+ * once the checkpoint is taken. Stopping at the end of a loop means
+ * nothing of the engine's own has to be saved: all there is to it
+ * is the tape, the pointer and where in the program it was.
+ *
+ * --jit moves a run from the interpreter to the JIT the same way,
+ * once its loops have run for long enough that compiling the
+ * program is worth it, see jit_hot().
+ */
+
+#include <limits.h>
+
+#include "bfint.h"
+
+#define LIMIT_CHUNK (1L << 20)	/* steps between looks at the clock */
+
+/*
+ * Sets up the limits for a run, which starts the clock on the
+ * timeout and the checkpoints.
+ *
+ * args: limits to set up, most steps to run or -1 for no limit,
+ *       most seconds to run for or 0 for no limit, seconds between
+ *       checkpoints or 0 for none, steps to run before moving to
+ *       the JIT or -1 for never
+ */
+void limit_init(struct limit *limit, double steps, double seconds,
+		double every, double hot)
+{
+	double now = io_time();
+
+	limit->steps = steps;
+	limit->deadline = seconds > 0 ? now + seconds : 0;
+	limit->hit = 0;
+	limit->every = every > 0 ? every : 0;
+	limit->due = now + limit->every;
+	limit->hot = hot;
+	limit->carry = 0;
+	limit->pc = 0;
+	limit->ptr = NULL;
+}
+
+/* hands out the next part of the budget */
+static long grant(struct limit *limit)
+{
+	long n = limit->deadline || limit->every ? LIMIT_CHUNK : LONG_MAX;
+
+	if (limit->steps >= 0 && limit->steps < (double) n)
+		n = (long) limit->steps;
+	if (limit->hot >= 0 && limit->hot < (double) n)
+		n = (long) limit->hot;
+
+	if (limit->steps >= 0)
+		limit->steps -= (double) n;
+	if (limit->hot >= 0)
+		limit->hot -= (double) n;
+
+	return n;
+}
+
+/*
+ * Stops the run for hit, to carry on from pc with the pointer at
+ * ptr. What the engine owes from the budget is carried over to the
+ * next run, so the steps come out the same as if it hadn't stopped.
+ */
+static long stop(struct limit *limit, int hit, long left, size_t pc,
+		 unsigned char *ptr)
+{
+	limit->hit = hit;
+	limit->carry = left;
+	limit->pc = pc;
+	limit->ptr = ptr;
+
+	return 0;
+}
+
+/* returns: the budget an engine starts with */
+long limit_start(struct limit *limit)
+{
+	long left;
+
+	if (!limit)
+		return LONG_MAX;
+
+	left = grant(limit) + limit->carry;
+	limit->carry = 0;
+
+	return left;
+}
+
+/*
+ * Gets an engine more budget when it's run out of what it had,
+ * which is the slow path of the check in OP_JNZ.
+ *
+ * args: limits, what the engine has left, which is 0 or less,
+ *       the instruction after the OP_JZ it's going back to, the
+ *       pointer
+ * returns: the new budget, or 0 if a limit has been reached, a
+ *          checkpoint is due or it's time for the JIT, with
+ *          limit->hit saying which
+ */
+long limit_more(struct limit *limit, long left, size_t pc,
+		unsigned char *ptr)
+{
+	double now;
+
+	if (!limit)
+		return LONG_MAX;
+
+	if (limit->deadline || limit->every) {
+		now = io_time();
+		if (limit->deadline && now >= limit->deadline) {
+			limit->hit = 't';
+			return 0;
+		}
+		if (limit->every && now >= limit->due) {
+			limit->due = now + limit->every;
+			return stop(limit, 'c', left, pc, ptr);
+		}
+	}
+
+	while (left <= 0) {
+		if (limit->steps == 0) {
+			limit->hit = 's';
+			return 0;
+		}
+		if (limit->hot == 0) {
+			limit->hot = -1;
+			return stop(limit, 'j', left, pc, ptr);
+		}
+		left += grant(limit);
+	}
+
+	return left;
+}
@@ -0,0 +1,150 @@
+/*
+ * The reports for --stats and --profile.
+ *
+ * For --profile, the profiling interpreter counts how
+ * many times each instruction runs; this works out from those
+ * counts which loops ran the most instructions, including the
+ * ones in loops inside them, and which instructions ran the most
+ * often, and says where in the source they are.
+ *
+ * Loops that optimize() turned into SET, MUL or SCAN aren't loops
+ * anymore, so they only show up as those instructions, at the
+ * offset of the loop's opening bracket. A hot loop that's still
+ * a loop is one the optimizer didn't catch.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "bfint.h"
+
+#define PROFILE_TOP 10	/* how many loops and instructions to list */
+
+/* in the same order as the enum in bfint.h */
+static const char *const names[] = {
+	"ADD", "MOVE", "OUT", "IN", "JZ", "JNZ", "SET", "MUL", "SCAN", "END"
+};
+
+struct hot {
+	size_t i;	/* instruction, or the JZ of a loop */
+	double n;	/* how many instructions that accounts for */
+};
+
+static int hotter(const void *a, const void *b)
+{
+	double x = ((const struct hot *) a)->n, y = ((const struct hot *) b)->n;
+
+	return x < y ? 1 : x > y ? -1 : 0;
+}
+
+/*
+ * Writes out the report.
+ *
+ * args: file to write to, program that was profiled, with source
+ *       offsets, how many times each instruction ran
+ * returns: 0 for success, 2 for bad memory allocation
+ */
+INT_STAT profile_report(FILE *fp, const struct program *prog,
+			const double *counts)
+{
+	const struct op *ops = prog->ops;
+	struct hot *loops, *insns;
+	double *sum, total;
+	size_t i, k, nloops = 0;
+
+	/* sum[i] is how many instructions ran before instruction i */
+	sum = (double *) malloc((prog->len + 1) * sizeof(double));
+	loops = (struct hot *) malloc(prog->len * sizeof(struct hot));
+	insns = (struct hot *) malloc(prog->len * sizeof(struct hot));
+	if (!sum || !loops || !insns) {
+		free(sum);
+		free(loops);
+		free(insns);
+		return INT_MEMERR;
+	}
+
+	sum[0] = 0;
+	for (i = 0; i < prog->len; ++i) {
+		sum[i + 1] = sum[i] + counts[i];
+		insns[i].i = i;
+		insns[i].n = counts[i];
+		if (ops[i].kind == OP_JZ)
+			loops[nloops++].i = i;
+	}
+
+	/* a loop runs everything from its JZ to its JNZ */
+	for (k = 0; k < nloops; ++k) {
+		i = loops[k].i;
+		loops[k].n = sum[ops[i].arg + 1] - sum[i];
+	}
+
+	total = sum[prog->len] ? sum[prog->len] : 1;
+	qsort(loops, nloops, sizeof(struct hot), hotter);
+	qsort(insns, prog->len, sizeof(struct hot), hotter);
+
+	fprintf(fp, "\nprofile: %.0f instructions, %lu loops left after "
+		"optimization\n", sum[prog->len], (unsigned long) nloops);
+
+	fprintf(fp, "\n%-19s %15s %7s %13s %15s\n", "loop (source)",
+		"instructions", "share", "entered", "iterations");
+	for (k = 0; k < nloops && k < PROFILE_TOP && loops[k].n; ++k) {
+		i = loops[k].i;
+		fprintf(fp, "%8lu-%-10lu %15.0f %6.2f%% %13.0f %15.0f\n",
+			(unsigned long) prog->pos[i],
+			(unsigned long) prog->pos[ops[i].arg],
+			loops[k].n, 100 * loops[k].n / total,
+			counts[i], counts[ops[i].arg]);
+	}
+
+	fprintf(fp, "\n%-8s %-5s %11s %15s %7s\n", "source", "op",
+		"arg", "count", "share");
+	for (k = 0; k < prog->len && k < PROFILE_TOP && insns[k].n; ++k) {
+		i = insns[k].i;
+		fprintf(fp, "%8lu %-5s %11ld %15.0f %6.2f%%\n",
+			(unsigned long) prog->pos[i], names[ops[i].kind],
+			ops[i].kind == OP_JZ || ops[i].kind == OP_JNZ
+				? 0L : ops[i].arg,
+			insns[k].n, 100 * insns[k].n / total);
+	}
+
+	free(sum);
+	free(loops);
+	free(insns);
+
+	return INT_SUCC;
+}
+
+/*
+ * Writes out the numbers for --stats. Time spent computing is
+ * the time spent running less the time spent in I/O, which is
+ * only the time spent in the actual reads and writes.
+ *
+ * args: file to write to, what was counted, tape the program ran
+ *       on, I/O state it used
+ */
+void stats_report(FILE *fp, const struct stats *stats,
+		  const struct tape *tape, const struct io *io)
+{
+	fputs("\n", fp);
+
+	if (stats->steps < 0)
+		fputs("stats: instructions not counted by this engine\n", fp);
+	else
+		fprintf(fp, "stats: %.0f instructions executed\n",
+			stats->steps);
+
+	fprintf(fp, "stats: %lu tape cells allocated",
+		(unsigned long) (tape->len / tape->width));
+	if (stats->steps < 0)
+		fputs("\n", fp);
+	else
+		fprintf(fp, ", pointer went from %ld to %ld\n",
+			stats->lo, stats->hi);
+
+	fprintf(fp, "stats: %.0f bytes read, %.0f bytes written\n",
+		io_read(io), io->nout);
+	fprintf(fp, "stats: %.6f s in I/O, %.6f s computing\n", io->time,
+		stats->run > io->time ? stats->run - io->time : 0);
+	fprintf(fp, "stats: %.6f s compiling, %.6f s optimizing\n",
+		stats->compile, stats->optimize);
+}
@@ -0,0 +1,193 @@
+/*
+ * Looking for the next zero cell, which is what OP_SCAN does for
+ * loops like [>] and [<<].
+ *
+ * Walking the tape a cell at a time costs a load, a compare and
+ * a branch for every cell. Going forwards a cell at a time is
+ * just memchr(), which the C library already does as fast as
+ * the machine allows. Everything else is done here, 16 bytes at
+ * a time with SSE2 or NEON where the compiler has them: compare
+ * the whole block against zero, turn that into a bit per byte,
+ * and keep only the bits of the cells the scan actually steps
+ * on. With a step that doesn't divide 16 those fall in a
+ * different place in each block, so the mask of them moves along
+ * as the scan does. Steps of more than SCAN_MAX bytes skip most
+ * of a block anyway, so those, and machines without either, use
+ * the plain loop.
+ *
+ * Distances are all in bytes here, and only ever cover cells
+ * that are on the tape; the interpreter moves the pointer and
+ * grows the tape afterwards.
+ */
+
+#include <string.h>
+
+#ifdef __GNUC__
+#if defined(__SSE2__)
+#define SCAN_SSE2
+#include <emmintrin.h>
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#define SCAN_NEON
+#include <arm_neon.h>
+#endif
+#endif
+
+#include "bfint.h"
+
+/* whether the cell of width bytes at p is zero */
+static int is_zero(const unsigned char *p, size_t width)
+{
+	while (width--)
+		if (*p++)
+			return 0;
+
+	return 1;
+}
+
+#if defined(SCAN_SSE2) || defined(SCAN_NEON)
+/*
+ * Returns a mask with bit i set if byte i of the block at p is
+ * part of a zero cell. Every cell in the block starts a multiple
+ * of width bytes in.
+ */
+static unsigned block_zeros(const unsigned char *p, size_t width)
+{
+#ifdef SCAN_SSE2
+	__m128i v = _mm_loadu_si128((const __m128i *) p);
+	__m128i z = _mm_setzero_si128();
+
+	v = width == 4 ? _mm_cmpeq_epi32(v, z)
+	  : width == 2 ? _mm_cmpeq_epi16(v, z) : _mm_cmpeq_epi8(v, z);
+
+	return (unsigned) _mm_movemask_epi8(v);
+#else
+	static const unsigned char bits[16] = {
+		1, 2, 4, 8, 16, 32, 64, 128, 1, 2, 4, 8, 16, 32, 64, 128
+	};
+	uint8x16_t v = vld1q_u8(p), m;
+
+	m = width == 4
+		? vreinterpretq_u8_u32(vceqzq_u32(vreinterpretq_u32_u8(v)))
+		: width == 2
+		? vreinterpretq_u8_u16(vceqzq_u16(vreinterpretq_u16_u8(v)))
+		: vceqzq_u8(v);
+	m = vandq_u8(m, vld1q_u8(bits));
+
+	return vaddv_u8(vget_low_u8(m)) |
+	       (unsigned) vaddv_u8(vget_high_u8(m)) << 8;
+#endif
+}
+
+/* a bit for every step bytes, starting from the lowest */
+static unsigned long stride_mask(size_t step)
+{
+	unsigned long mask = 0;
+	size_t i;
+
+	for (i = 0; i < 2 * SCAN_MAX; i += step)
+		mask |= 1UL << i;
+
+	return mask;
+}
+#endif
+
+/*
+ * Finds the first zero cell at p or after it.
+ *
+ * args: first cell to look at, bytes from there to the end of
+ *       the tape, bytes between the cells to look at, bytes in
+ *       a cell
+ * returns: how far the zero cell is from p, or how far the first
+ *          cell the scan would step on past the end of the tape
+ *          is if there isn't one
+ */
+size_t scan_right(const unsigned char *p, size_t len, size_t step,
+		  size_t width)
+{
+	const unsigned char *z;
+	size_t i = 0;
+#if defined(SCAN_SSE2) || defined(SCAN_NEON)
+	unsigned long base;
+	unsigned m;
+	size_t r, skip;
+#endif
+
+	if (step == 1) {
+		z = (const unsigned char *) memchr(p, 0, len);
+		return z ? (size_t) (z - p) : len;
+	}
+
+#if defined(SCAN_SSE2) || defined(SCAN_NEON)
+	if (step <= SCAN_MAX) {
+		base = stride_mask(step);
+		skip = step - SCAN_MAX % step;
+
+		/* bit b is a cell stepped on if i + b is a multiple of step */
+		for (r = 0; i + SCAN_MAX <= len; i += SCAN_MAX) {
+			m = block_zeros(p + i, width) & (unsigned) (base << r);
+			if (m)
+				return i + (size_t) __builtin_ctz(m);
+			r += skip;
+			if (r >= step)
+				r -= step;
+		}
+	}
+#endif
+
+	for (i = (i + step - 1) / step * step; i < len; i += step)
+		if (is_zero(p + i, width))
+			break;
+
+	return i;
+}
+
+/*
+ * Finds the first zero cell at p or before it.
+ *
+ * args: first cell to look at, bytes from the start of the tape
+ *       up to the end of that cell, bytes between the cells to
+ *       look at, bytes in a cell
+ * returns: how far back the zero cell is from p, or how far back
+ *          the first cell the scan would step on before the start
+ *          of the tape is if there isn't one
+ */
+size_t scan_left(const unsigned char *p, size_t len, size_t step,
+		 size_t width)
+{
+	size_t i = 0;
+#if defined(SCAN_SSE2) || defined(SCAN_NEON)
+	const unsigned char *q;
+	unsigned long base;
+	unsigned m;
+	size_t r, skip;
+
+	/*
+	 * The block i bytes back ends with the last byte of the cell
+	 * i bytes before p, so cell p - d starts at byte
+	 * SCAN_MAX - width - d + i of it. The nearest one is the
+	 * highest bit.
+	 */
+	if (step <= SCAN_MAX) {
+		base = stride_mask(step);
+		skip = SCAN_MAX % step;
+		r = (SCAN_MAX - width) % step;
+
+		for (; i + SCAN_MAX <= len; i += SCAN_MAX) {
+			q = p + width - SCAN_MAX - i;
+			m = block_zeros(q, width) & (unsigned) (base << r);
+			if (m)
+				return i + SCAN_MAX - width -
+				       (size_t) (31 - __builtin_clz(m));
+			r += skip;
+			if (r >= step)
+				r -= step;
+		}
+	}
+#endif
+
+	for (i = (i + step - 1) / step * step; i + width <= len; i += step)
+		if (is_zero(p - i, width))
+			break;
+
+	return i;
+}
@@ -0,0 +1,448 @@
+/*
+ * The tape.
+ *
+ * Normally it's a single block from calloc() that doubles in size
+ * whenever the pointer runs off either end, and every engine
+ * checks each move against the ends before making it.
+ *
+ * Once it's big, on POSIX systems, the block is mapped straight
+ * from the system instead, and growing it only copies the parts
+ * of the old one that aren't zero. The system doesn't give a
+ * mapping any memory until it's written to, so a program that
+ * goes a long way out and only uses a few cells on the way only
+ * costs memory for the pages it used, not for all of the tape.
+ * --max-tape caps how long the tape can get at all, and past that
+ * the pointer has run off the end of it.
+ *
+ * With --guard, on POSIX systems, it's a huge reservation of
+ * address space instead, of which only the cells in use are
+ * actually mapped. The pages on either side of those are
+ * PROT_NONE, so when the pointer runs off what's mapped, the
+ * next access faults, and the SIGSEGV handler here maps more of
+ * the reservation and lets the access go again. The interpreter
+ * doesn't check its moves at all then, and the cells never move,
+ * so the tape is still infinite in both directions for as long
+ * as the address space lasts.
+ *
+ * Each end of the reservation has a band that's never mapped,
+ * wider than any one instruction can reach past the last cell
+ * it touched. Running off the tape for real faults in there
+ * rather than landing in some other mapping, and the handler
+ * jumps back out of the interpreter with INT_BOUNDS.
+ */
+
+#if defined(__unix__) || defined(__APPLE__)
+#define TAPE_GUARD
+#define _POSIX_C_SOURCE 200809L
+#define _DEFAULT_SOURCE
+#define _DARWIN_C_SOURCE
+#endif
+
+#include <limits.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef TAPE_GUARD
+#include <setjmp.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#ifndef MAP_ANONYMOUS
+#define MAP_ANONYMOUS MAP_ANON
+#endif
+#ifndef MAP_NORESERVE
+#define MAP_NORESERVE 0
+#endif
+#endif
+
+#include "bfint.h"
+
+#ifdef TAPE_GUARD
+#define TAPE_MAP ((size_t) 1 << 16)	/* smallest tape to map */
+#else
+#define TAPE_MAP ((size_t) -1)
+#endif
+
+/* zeroed memory for len bytes of cells, mapped if they're many */
+static unsigned char *alloc_cells(size_t len, int *mapped)
+{
+#ifdef TAPE_GUARD
+	void *map;
+
+	if (len >= TAPE_MAP) {
+		map = mmap(NULL, len, PROT_READ | PROT_WRITE,
+			   MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+		*mapped = 1;
+		return map == MAP_FAILED ? NULL : (unsigned char *) map;
+	}
+#endif
+	*mapped = 0;
+
+	return (unsigned char *) calloc(len, 1);
+}
+
+static void free_cells(unsigned char *cells, size_t len, int mapped)
+{
+#ifdef TAPE_GUARD
+	if (mapped) {
+		munmap(cells, len);
+		return;
+	}
+#endif
+	(void) len;
+	(void) mapped;
+	free(cells);
+}
+
+/*
+ * Copies cells into zeroed memory a TAPE_INIT chunk at a time,
+ * leaving out the chunks that are all zero. Pages of the old
+ * cells that were never written to are only read, which doesn't
+ * give them any memory either.
+ */
+static void copy_cells(unsigned char *to, const unsigned char *from,
+		       size_t len)
+{
+	size_t n;
+
+	for (; len; len -= n, from += n, to += n) {
+		n = len < TAPE_INIT ? len : TAPE_INIT;
+		if (*from || memcmp(from, from + 1, n - 1))
+			memcpy(to, from, n);
+	}
+}
+
+#ifdef TAPE_GUARD
+/*
+ * How much address space to reserve at most. The high shift
+ * comes to 0 rather than overflowing where size_t is 32 bits,
+ * but those use the other one anyway.
+ */
+#define TAPE_RESERVE (sizeof(size_t) > 4 \
+	? (size_t) 1 << 20 << 20 : (size_t) 1 << 30)
+
+/*
+ * Maps the add cells on the left or right of a guarded tape, as
+ * far as the guard bands allow, and whole pages of them since
+ * that's what mprotect() deals in.
+ *
+ * args: tape to grow, index of the pointer, cells to add, how
+ *       many of them are really needed, nonzero for the left
+ * returns: the rebased pointer, or NULL if the tape can't grow
+ */
+static unsigned char *guard_grow(struct tape *tape, size_t pos, size_t add,
+				 size_t need, int left)
+{
+	size_t page = tape->page, room;
+	unsigned char *from, *to;
+
+	room = left ? (size_t) (tape->cells - tape->base) - tape->guard
+		    : (size_t) (tape->base + tape->size - tape->guard -
+				(tape->cells + tape->len));
+	if (need > room)
+		return NULL;
+	if (add > room)
+		add = room;
+
+	from = left ? tape->cells - add : tape->cells + tape->len;
+	to = from + add;
+	from = tape->base + (from - tape->base) / page * page;
+	to = tape->base + ((to - tape->base) + page - 1) / page * page;
+	if (mprotect(from, to - from, PROT_READ | PROT_WRITE))
+		return NULL;
+
+	if (left) {
+		tape->cells -= add;
+		tape->origin += add;
+		pos += add;
+	}
+	tape->len += add;
+
+	return tape->cells + pos;
+}
+#endif
+
+/*
+ * Grows the tape until the cell n cells away from the one at ptr
+ * is on it. The tape doubles in size each time, adding the new
+ * cells to the left if n is negative and to the right otherwise.
+ * The contents of the tape never move relative to each other, so
+ * a pointer into the old tape can be rebased onto the new one.
+ *
+ * Growing a small tape to the right is a realloc(). Otherwise the
+ * cells have to move anyway, so they go into a fresh block that's
+ * already zeroed, see copy_cells(): that's one copy rather than
+ * realloc()'s and memmove()'s. A guarded tape just maps more of
+ * its reservation and doesn't move.
+ *
+ * If the tape would have to be longer than its limit, it stays
+ * as it is and is marked full.
+ *
+ * args: tape to grow, pointer to a cell, cells to cover
+ * returns: the rebased pointer, or NULL for bad memory allocation
+ *          or a full tape
+ */
+unsigned char *tape_grow(struct tape *tape, unsigned char *ptr, long n)
+{
+	size_t pos = ptr - tape->cells;
+	size_t len = tape->len, add;
+	size_t max = !tape->max ? SIZE_MAX / 2 + 1
+		   : tape->max < TAPE_LEAST ? TAPE_LEAST
+		   : tape->max / tape->width * tape->width;
+	unsigned char *cells;
+	int mapped;
+
+	/* the rest is in bytes */
+	if (n > LONG_MAX / (long) tape->width ||
+	    n < -(LONG_MAX / (long) tape->width))
+		return NULL;
+	n *= (long) tape->width;
+
+	do {
+		if (len >= max) {
+			tape->full = tape->max != 0;
+			return NULL;
+		}
+		len = len > max / 2 ? max : len * 2;
+		add = len - tape->len;
+	} while (n < 0 ? pos + add < (size_t) -n : pos + n >= len);
+
+#ifdef TAPE_GUARD
+	if (tape->base)
+		return n < 0
+			? guard_grow(tape, pos, add, (size_t) -n - pos, 1)
+			: guard_grow(tape, pos, add,
+				     pos + n + 1 - tape->len, 0);
+#endif
+
+	if (n >= 0 && len < TAPE_MAP) {
+		cells = (unsigned char *) realloc(tape->cells, len);
+		if (!cells)
+			return NULL;
+		memset(cells + tape->len, 0, add);
+	} else {
+		cells = alloc_cells(len, &mapped);
+		if (!cells)
+			return NULL;
+		copy_cells(n < 0 ? cells + add : cells, tape->cells, tape->len);
+		free_cells(tape->cells, tape->len, tape->mapped);
+		tape->mapped = mapped;
+		if (n < 0) {
+			pos += add;
+			tape->origin += add;
+		}
+	}
+
+	tape->cells = cells;
+	tape->len = len;
+
+	return cells + pos;
+}
+
+/*
+ * Grows the tape until there are at least margin cells on both
+ * sides of ptr, which the engines rely on before they start.
+ *
+ * args: tape to grow, pointer to a cell, cells needed
+ * returns: the rebased pointer, or NULL for bad memory allocation
+ */
+unsigned char *tape_reserve(struct tape *tape, unsigned char *ptr,
+			    long margin)
+{
+	size_t width = tape->width;
+
+	if (ptr && (size_t) (ptr - tape->cells) / width < (size_t) margin)
+		ptr = tape_grow(tape, ptr, -margin);
+	if (ptr && (size_t) (tape->cells + tape->len - width - ptr) / width <
+		   (size_t) margin)
+		ptr = tape_grow(tape, ptr, margin);
+
+	return ptr;
+}
+
+#ifdef TAPE_GUARD
+static struct tape *volatile guarded;	/* the tape being run on */
+static volatile sig_atomic_t fault;	/* why the run was cut short */
+static sigjmp_buf escape;
+static struct sigaction old_segv, old_bus;
+
+/*
+ * Maps in the cell a fault was at if it's on the guarded tape,
+ * and jumps out of the run if the tape can't reach it. Faults
+ * anywhere else are real, so those go back to crashing the way
+ * they would have without the handler.
+ */
+static void on_fault(int sig, siginfo_t *info, void *context)
+{
+	struct tape *tape = guarded;
+	unsigned char *at = (unsigned char *) info->si_addr, *end;
+
+	(void) context;
+
+	if (!tape || at < tape->base || at >= tape->base + tape->size) {
+		signal(sig, SIG_DFL);
+		return;
+	}
+
+	if (at < tape->base + tape->guard ||
+	    at >= tape->base + tape->size - tape->guard) {
+		fault = INT_BOUNDS;
+		siglongjmp(escape, 1);
+	}
+
+	/* the cell at is in, counting from the first or last one */
+	end = tape->cells + tape->len - tape->width;
+	if (!(at < tape->cells
+		? tape_grow(tape, tape->cells, -(long) ((tape->cells - at +
+				tape->width - 1) / tape->width))
+		: tape_grow(tape, end, (long) ((at - end) / tape->width)))) {
+		fault = INT_MEMERR;
+		siglongjmp(escape, 1);
+	}
+}
+#endif
+
+/*
+ * Turns a fresh tape into a guarded one, if that can be done
+ * here and nothing in the program reaches too far for the guard
+ * bands. The tape is left as it was if not.
+ *
+ * args: tape that hasn't been used yet, program to run on it
+ * returns: nonzero if the tape is now guarded
+ */
+int tape_guard(struct tape *tape, const struct program *prog)
+{
+#ifdef TAPE_GUARD
+	struct sigaction sa;
+	unsigned long step, reach = 0;
+	size_t i, page, size, len;
+	unsigned char *base;
+	void *map = MAP_FAILED;
+
+	/* the furthest the pointer can get between two accesses */
+	for (i = 0; i < prog->len; ++i) {
+		if (prog->ops[i].kind != OP_MOVE &&
+		    prog->ops[i].kind != OP_SCAN)
+			continue;
+		step = prog->ops[i].arg < 0 ? -(unsigned long) prog->ops[i].arg
+					    : (unsigned long) prog->ops[i].arg;
+		if (step > reach)
+			reach = step;
+	}
+
+	page = (size_t) sysconf(_SC_PAGESIZE);
+	if (!page || (page & (page - 1)) || reach > TAPE_RESERVE / 16 ||
+	    prog->margin > TAPE_RESERVE / 16)
+		return 0;
+
+	/* whole pages, so the bands can be left unmapped */
+	tape->guard = (reach + prog->margin) * tape->width / page * page +
+		      2 * page;
+	len = (tape->len + page - 1) / page * page;
+
+	for (size = TAPE_RESERVE; size / 4 > tape->guard + len; size /= 2) {
+		map = mmap(NULL, size, PROT_NONE,
+			   MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+		if (map != MAP_FAILED)
+			break;
+	}
+	if (map == MAP_FAILED)
+		return 0;
+
+	base = (unsigned char *) map;
+	sa.sa_sigaction = on_fault;
+	sa.sa_flags = SA_SIGINFO;
+	sigemptyset(&sa.sa_mask);
+	if (mprotect(base + size / 2, len, PROT_READ | PROT_WRITE) ||
+	    sigaction(SIGSEGV, &sa, &old_segv)) {
+		munmap(map, size);
+		return 0;
+	}
+	if (sigaction(SIGBUS, &sa, &old_bus)) {
+		sigaction(SIGSEGV, &old_segv, NULL);
+		munmap(map, size);
+		return 0;
+	}
+
+	free(tape->cells);
+	tape->cells = base + size / 2;
+	tape->len = len;
+	tape->base = base;
+	tape->size = size;
+	tape->page = page;
+
+	return 1;
+#else
+	(void) tape;
+	(void) prog;
+
+	return 0;
+#endif
+}
+
+/*
+ * Runs an interpreter that doesn't check its moves on a guarded
+ * tape, catching it if it runs off the tape.
+ *
+ * args: guarded tape, interpreter to run, program, I/O state,
+ *       limits on the run
+ * returns: what the interpreter returned, 2 for bad memory
+ *          allocation or 4 if the pointer ran off the tape
+ */
+INT_STAT tape_run(struct tape *tape, interp_fn interp,
+		  const struct program *prog, struct io *io,
+		  struct limit *limit)
+{
+#ifdef TAPE_GUARD
+	INT_STAT status;
+
+	guarded = tape;
+	if (sigsetjmp(escape, 1))
+		status = (INT_STAT) fault;
+	else
+		status = interp(tape, prog, io, limit, NULL);
+	guarded = NULL;
+
+	return status;
+#else
+	return interp(tape, prog, io, limit, NULL);
+#endif
+}
+
+/*
+ * Empties a tape that isn't guarded, giving back all but TAPE_INIT
+ * bytes of it. If even that much can't be had afresh, the whole
+ * of it is cleared instead.
+ */
+void tape_clear(struct tape *tape)
+{
+	unsigned char *cells = NULL;
+
+	if (tape->len > TAPE_INIT)
+		cells = (unsigned char *) calloc(TAPE_INIT, 1);
+
+	if (cells) {
+		free_cells(tape->cells, tape->len, tape->mapped);
+		tape->cells = cells;
+		tape->len = TAPE_INIT;
+		tape->mapped = 0;
+	} else {
+		memset(tape->cells, 0, tape->len);
+	}
+	tape->origin = 0;
+	tape->full = 0;
+}
+
+/* frees the tape, guarded or not */
+void tape_free(struct tape *tape)
+{
+#ifdef TAPE_GUARD
+	if (tape->base) {
+		sigaction(SIGSEGV, &old_segv, NULL);
+		sigaction(SIGBUS, &old_bus, NULL);
+		munmap(tape->base, tape->size);
+		return;
+	}
+#endif
+	free_cells(tape->cells, tape->len, tape->mapped);
+}